@@ -0,0 +1,357 @@
+
+#include "geodesy.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#define GEODESY_HAS_SIMD 1
+#else
+#define GEODESY_HAS_SIMD 0
+#endif
+
+using namespace std;
+
+namespace
+{
+    constexpr double pi = 3.14159265358979323846;
+    constexpr double deg_to_rad = pi / 180.0;
+    constexpr double rad_to_deg = 180.0 / pi;
+
+    // WGS84 ellipsoid
+    constexpr double wgs84_a = 6378137.0;
+    constexpr double wgs84_f = 1.0 / 298.257223563;
+    constexpr double wgs84_b = wgs84_a * (1.0 - wgs84_f);
+
+    constexpr int vincenty_max_iterations = 200;
+    constexpr double vincenty_tolerance = 1e-12;
+
+    using pair_kernel = void (*)(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t begin, size_t end);
+
+    void haversine_scalar(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            out[i] = haversine_distance(lat1[i], lon1[i], lat2[i], lon2[i]);
+        }
+    }
+
+    void bearing_scalar(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            out[i] = initial_bearing(lat1[i], lon1[i], lat2[i], lon2[i]);
+        }
+    }
+
+    void vincenty_scalar(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            out[i] = vincenty_distance(lat1[i], lon1[i], lat2[i], lon2[i]);
+        }
+    }
+
+#if GEODESY_HAS_SIMD
+    namespace stdx = std::experimental;
+    using simd_double = stdx::native_simd<double>;
+
+    void haversine_simd(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t begin, size_t end)
+    {
+        constexpr size_t width = simd_double::size();
+
+        size_t i = begin;
+        for (; i + width <= end; i += width)
+        {
+            simd_double phi1(lat1 + i, stdx::element_aligned);
+            simd_double phi2(lat2 + i, stdx::element_aligned);
+            simd_double lambda1(lon1 + i, stdx::element_aligned);
+            simd_double lambda2(lon2 + i, stdx::element_aligned);
+
+            simd_double sin_dphi = stdx::sin((phi2 - phi1) * (deg_to_rad * 0.5));
+            simd_double sin_dlambda = stdx::sin((lambda2 - lambda1) * (deg_to_rad * 0.5));
+            simd_double a = sin_dphi * sin_dphi + stdx::cos(phi1 * deg_to_rad) * stdx::cos(phi2 * deg_to_rad) * sin_dlambda * sin_dlambda;
+            a = stdx::min(a, simd_double(1.0));
+
+            simd_double d = (2.0 * earth_mean_radius_m) * stdx::asin(stdx::sqrt(a));
+            d.copy_to(out + i, stdx::element_aligned);
+        }
+
+        haversine_scalar(lat1, lon1, lat2, lon2, out, i, end);
+    }
+
+    void bearing_simd(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t begin, size_t end)
+    {
+        constexpr size_t width = simd_double::size();
+
+        size_t i = begin;
+        for (; i + width <= end; i += width)
+        {
+            simd_double phi1 = simd_double(lat1 + i, stdx::element_aligned) * deg_to_rad;
+            simd_double phi2 = simd_double(lat2 + i, stdx::element_aligned) * deg_to_rad;
+            simd_double dlambda = (simd_double(lon2 + i, stdx::element_aligned) - simd_double(lon1 + i, stdx::element_aligned)) * deg_to_rad;
+
+            simd_double cos_phi2 = stdx::cos(phi2);
+            simd_double y = stdx::sin(dlambda) * cos_phi2;
+            simd_double x = stdx::cos(phi1) * stdx::sin(phi2) - stdx::sin(phi1) * cos_phi2 * stdx::cos(dlambda);
+
+            simd_double theta = stdx::atan2(y, x) * rad_to_deg;
+            stdx::where(theta < 0.0, theta) += 360.0;
+            theta.copy_to(out + i, stdx::element_aligned);
+        }
+
+        bearing_scalar(lat1, lon1, lat2, lon2, out, i, end);
+    }
+#endif
+
+    pair_kernel select_distance_kernel(const geodesy_options& options)
+    {
+        if (options.method == geodesy_method::vincenty)
+        {
+            return vincenty_scalar;
+        }
+#if GEODESY_HAS_SIMD
+        if (options.kernel == geodesy_kernel::simd)
+        {
+            return haversine_simd;
+        }
+#endif
+        return haversine_scalar;
+    }
+
+    pair_kernel select_bearing_kernel(const geodesy_options& options)
+    {
+#if GEODESY_HAS_SIMD
+        if (options.kernel == geodesy_kernel::simd)
+        {
+            return bearing_simd;
+        }
+#endif
+        return bearing_scalar;
+    }
+
+    void run_kernel(pair_kernel kernel, const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t count, const geodesy_options& options)
+    {
+        size_t thread_count = 1;
+
+        if (options.execution == geodesy_execution::parallel ||
+            (options.execution == geodesy_execution::automatic && count >= options.parallel_threshold))
+        {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+            thread_count = std::min(thread_count, std::max<size_t>(1, count));
+        }
+
+        if (thread_count == 1)
+        {
+            kernel(lat1, lon1, lat2, lon2, out, 0, count);
+            return;
+        }
+
+        // Contiguous chunks, the calling thread takes the last one
+        size_t chunk = (count + thread_count - 1) / thread_count;
+
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count - 1);
+
+        for (size_t t = 0; t + 1 < thread_count; t++)
+        {
+            size_t begin = t * chunk;
+            size_t end = std::min(count, begin + chunk);
+            threads.emplace_back(kernel, lat1, lon1, lat2, lon2, out, begin, end);
+        }
+
+        kernel(lat1, lon1, lat2, lon2, out, std::min(count, (thread_count - 1) * chunk), count);
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    bool try_run_pairwise(pair_kernel kernel, std::span<const double> lat1, std::span<const double> lon1, std::span<const double> lat2, std::span<const double> lon2, std::span<double> out, const geodesy_options& options)
+    {
+        size_t count = lat1.size();
+
+        if (lon1.size() != count || lat2.size() != count || lon2.size() != count || out.size() != count)
+        {
+            return false;
+        }
+
+        run_kernel(kernel, lat1.data(), lon1.data(), lat2.data(), lon2.data(), out.data(), count, options);
+
+        return true;
+    }
+
+    bool try_run_segments(pair_kernel kernel, std::span<const double> lat, std::span<const double> lon, std::span<double> out, const geodesy_options& options)
+    {
+        if (lat.size() != lon.size())
+        {
+            return false;
+        }
+
+        if (lat.empty())
+        {
+            return out.empty();
+        }
+
+        return try_run_pairwise(kernel, lat.first(lat.size() - 1), lon.first(lon.size() - 1), lat.subspan(1), lon.subspan(1), out, options);
+    }
+}
+
+double haversine_distance(double lat1, double lon1, double lat2, double lon2)
+{
+    double sin_dphi = std::sin((lat2 - lat1) * deg_to_rad * 0.5);
+    double sin_dlambda = std::sin((lon2 - lon1) * deg_to_rad * 0.5);
+    double a = sin_dphi * sin_dphi + std::cos(lat1 * deg_to_rad) * std::cos(lat2 * deg_to_rad) * sin_dlambda * sin_dlambda;
+    a = std::min(a, 1.0);
+    return 2.0 * earth_mean_radius_m * std::asin(std::sqrt(a));
+}
+
+bool try_vincenty_distance(double lat1, double lon1, double lat2, double lon2, double& distance)
+{
+    // Vincenty inverse formula on the WGS84 ellipsoid
+
+    double L = (lon2 - lon1) * deg_to_rad;
+    double U1 = std::atan((1.0 - wgs84_f) * std::tan(lat1 * deg_to_rad));
+    double U2 = std::atan((1.0 - wgs84_f) * std::tan(lat2 * deg_to_rad));
+    double sin_U1 = std::sin(U1);
+    double cos_U1 = std::cos(U1);
+    double sin_U2 = std::sin(U2);
+    double cos_U2 = std::cos(U2);
+
+    double lambda = L;
+    double sin_sigma = 0;
+    double cos_sigma = 0;
+    double sigma = 0;
+    double cos_sq_alpha = 0;
+    double cos_2sigma_m = 0;
+
+    int iteration = 0;
+
+    for (; iteration < vincenty_max_iterations; iteration++)
+    {
+        double sin_lambda = std::sin(lambda);
+        double cos_lambda = std::cos(lambda);
+
+        double t1 = cos_U2 * sin_lambda;
+        double t2 = cos_U1 * sin_U2 - sin_U1 * cos_U2 * cos_lambda;
+        sin_sigma = std::sqrt(t1 * t1 + t2 * t2);
+
+        if (sin_sigma == 0)
+        {
+            // Coincident points
+            distance = 0;
+            return true;
+        }
+
+        cos_sigma = sin_U1 * sin_U2 + cos_U1 * cos_U2 * cos_lambda;
+        sigma = std::atan2(sin_sigma, cos_sigma);
+
+        double sin_alpha = cos_U1 * cos_U2 * sin_lambda / sin_sigma;
+        cos_sq_alpha = 1.0 - sin_alpha * sin_alpha;
+
+        // Equatorial line
+        cos_2sigma_m = (cos_sq_alpha != 0) ? (cos_sigma - 2.0 * sin_U1 * sin_U2 / cos_sq_alpha) : 0;
+
+        double C = wgs84_f / 16.0 * cos_sq_alpha * (4.0 + wgs84_f * (4.0 - 3.0 * cos_sq_alpha));
+        double lambda_prev = lambda;
+        lambda = L + (1.0 - C) * wgs84_f * sin_alpha * (sigma + C * sin_sigma * (cos_2sigma_m + C * cos_sigma * (-1.0 + 2.0 * cos_2sigma_m * cos_2sigma_m)));
+
+        if (std::abs(lambda - lambda_prev) < vincenty_tolerance)
+        {
+            break;
+        }
+    }
+
+    if (iteration >= vincenty_max_iterations)
+    {
+        // Does not converge for nearly antipodal points
+        return false;
+    }
+
+    double u_sq = cos_sq_alpha * (wgs84_a * wgs84_a - wgs84_b * wgs84_b) / (wgs84_b * wgs84_b);
+    double A = 1.0 + u_sq / 16384.0 * (4096.0 + u_sq * (-768.0 + u_sq * (320.0 - 175.0 * u_sq)));
+    double B = u_sq / 1024.0 * (256.0 + u_sq * (-128.0 + u_sq * (74.0 - 47.0 * u_sq)));
+    double delta_sigma = B * sin_sigma * (cos_2sigma_m + B / 4.0 * (cos_sigma * (-1.0 + 2.0 * cos_2sigma_m * cos_2sigma_m) -
+        B / 6.0 * cos_2sigma_m * (-3.0 + 4.0 * sin_sigma * sin_sigma) * (-3.0 + 4.0 * cos_2sigma_m * cos_2sigma_m)));
+
+    distance = wgs84_b * A * (sigma - delta_sigma);
+
+    return true;
+}
+
+double vincenty_distance(double lat1, double lon1, double lat2, double lon2)
+{
+    double distance = 0;
+    if (try_vincenty_distance(lat1, lon1, lat2, lon2, distance))
+    {
+        return distance;
+    }
+    return haversine_distance(lat1, lon1, lat2, lon2);
+}
+
+double initial_bearing(double lat1, double lon1, double lat2, double lon2)
+{
+    double phi1 = lat1 * deg_to_rad;
+    double phi2 = lat2 * deg_to_rad;
+    double dlambda = (lon2 - lon1) * deg_to_rad;
+
+    double y = std::sin(dlambda) * std::cos(phi2);
+    double x = std::cos(phi1) * std::sin(phi2) - std::sin(phi1) * std::cos(phi2) * std::cos(dlambda);
+
+    double theta = std::atan2(y, x) * rad_to_deg;
+    return (theta < 0) ? (theta + 360.0) : theta;
+}
+
+bool geodesy_simd_available()
+{
+    return GEODESY_HAS_SIMD;
+}
+
+bool try_compute_distances(std::span<const double> lat1, std::span<const double> lon1, std::span<const double> lat2, std::span<const double> lon2, std::span<double> distances, const geodesy_options& options)
+{
+    return try_run_pairwise(select_distance_kernel(options), lat1, lon1, lat2, lon2, distances, options);
+}
+
+bool try_compute_bearings(std::span<const double> lat1, std::span<const double> lon1, std::span<const double> lat2, std::span<const double> lon2, std::span<double> bearings, const geodesy_options& options)
+{
+    return try_run_pairwise(select_bearing_kernel(options), lat1, lon1, lat2, lon2, bearings, options);
+}
+
+bool try_compute_segment_distances(std::span<const double> lat, std::span<const double> lon, std::span<double> distances, const geodesy_options& options)
+{
+    return try_run_segments(select_distance_kernel(options), lat, lon, distances, options);
+}
+
+bool try_compute_segment_bearings(std::span<const double> lat, std::span<const double> lon, std::span<double> bearings, const geodesy_options& options)
+{
+    return try_run_segments(select_bearing_kernel(options), lat, lon, bearings, options);
+}
+
+bool try_compute_odometer(std::span<const double> lat, std::span<const double> lon, std::span<double> odometer, const geodesy_options& options)
+{
+    if (lat.size() != lon.size() || odometer.size() != lat.size())
+    {
+        return false;
+    }
+
+    if (odometer.empty())
+    {
+        return true;
+    }
+
+    odometer[0] = 0;
+
+    if (!try_compute_segment_distances(lat, lon, odometer.subspan(1), options))
+    {
+        return false;
+    }
+
+    std::inclusive_scan(odometer.begin(), odometer.end(), odometer.begin());
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+
+// Mean earth radius in meters, used by the spherical (haversine) model
+constexpr double earth_mean_radius_m = 6371008.8;
+
+enum class geodesy_method
+{
+    haversine,
+    vincenty
+};
+
+enum class geodesy_kernel
+{
+    scalar,
+    simd
+};
+
+enum class geodesy_execution
+{
+    automatic,
+    sequential,
+    parallel
+};
+
+struct geodesy_options
+{
+    geodesy_method method = geodesy_method::haversine;
+    geodesy_kernel kernel = geodesy_kernel::simd;
+    geodesy_execution execution = geodesy_execution::automatic;
+    // Inputs with at least this many elements are split across threads when execution is automatic
+    std::size_t parallel_threshold = 1 << 16;
+};
+
+// Single pair, all angles in decimal degrees, distances in meters, bearings in [0, 360)
+double haversine_distance(double lat1, double lon1, double lat2, double lon2);
+bool try_vincenty_distance(double lat1, double lon1, double lat2, double lon2, double& distance);
+double vincenty_distance(double lat1, double lon1, double lat2, double lon2);
+double initial_bearing(double lat1, double lon1, double lat2, double lon2);
+
+bool geodesy_simd_available();
+
+// Batch, SoA layout: point i is (lat[i], lon[i])
+// Pairwise: distances[i] is the distance from (lat1[i], lon1[i]) to (lat2[i], lon2[i])
+bool try_compute_distances(std::span<const double> lat1, std::span<const double> lon1, std::span<const double> lat2, std::span<const double> lon2, std::span<double> distances, const geodesy_options& options = {});
+bool try_compute_bearings(std::span<const double> lat1, std::span<const double> lon1, std::span<const double> lat2, std::span<const double> lon2, std::span<double> bearings, const geodesy_options& options = {});
+
+// Track: segment i goes from point i to point i + 1, outputs have lat.size() - 1 elements
+bool try_compute_segment_distances(std::span<const double> lat, std::span<const double> lon, std::span<double> distances, const geodesy_options& options = {});
+bool try_compute_segment_bearings(std::span<const double> lat, std::span<const double> lon, std::span<double> bearings, const geodesy_options& options = {});
+
+// Track: odometer[i] is the distance travelled from point 0 to point i, output has lat.size() elements
+bool try_compute_odometer(std::span<const double> lat, std::span<const double> lon, std::span<double> odometer, const geodesy_options& options = {});
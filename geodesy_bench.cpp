@@ -0,0 +1,260 @@
+#include "geodesy.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// DECLARATIONS                                                     //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct track
+{
+    std::vector<double> lat;
+    std::vector<double> lon;
+};
+
+struct reference_distance
+{
+    const char* name;
+    double lat1;
+    double lon1;
+    double lat2;
+    double lon2;
+    geodesy_method method;
+    double expected;
+    double tolerance;
+};
+
+track make_random_track(std::size_t count);
+bool check_reference_values();
+double angle_difference(double a, double b);
+bool check_kernels_agree(const track& t);
+double benchmark(const track& t, const geodesy_options& options, int iterations);
+
+int main(int argc, char* argv[]);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+//                                                                  //
+//                                                                  //
+// IMPLEMENTATION                                                   //
+//                                                                  //
+//                                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+track make_random_track(std::size_t count)
+{
+    // Random walk with GPS-like step sizes
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> step(-0.0005, 0.0005);
+
+    track t;
+    t.lat.resize(count);
+    t.lon.resize(count);
+
+    double lat = 47.6101;
+    double lon = -122.2015;
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        lat = std::clamp(lat + step(rng), -89.0, 89.0);
+        lon = lon + step(rng);
+        t.lat[i] = lat;
+        t.lon[i] = lon;
+    }
+
+    return t;
+}
+
+bool check_reference_values()
+{
+    const reference_distance references[] =
+    {
+        // One degree of arc along the equator on the mean sphere
+        { "haversine equator 1 deg", 0.0, 0.0, 0.0, 1.0, geodesy_method::haversine, 111195.0802, 0.001 },
+        // Quarter meridian on the mean sphere
+        { "haversine pole to equator", 90.0, 0.0, 0.0, 0.0, geodesy_method::haversine, 10007557.2207, 0.001 },
+        // Flinders Peak to Buninyong, from Vincenty (1975)
+        { "vincenty flinders peak", -37.0 - 57.0 / 60.0 - 3.72030 / 3600.0, 144.0 + 25.0 / 60.0 + 29.52440 / 3600.0,
+                                    -37.0 - 39.0 / 60.0 - 10.15610 / 3600.0, 143.0 + 55.0 / 60.0 + 35.38390 / 3600.0,
+                                    geodesy_method::vincenty, 54972.271, 0.001 },
+        // One degree of longitude along the equator on WGS84
+        { "vincenty equator 1 deg", 0.0, 0.0, 0.0, 1.0, geodesy_method::vincenty, 111319.4908, 0.001 },
+    };
+
+    bool result = true;
+
+    for (const auto& r : references)
+    {
+        double d = (r.method == geodesy_method::haversine) ?
+            haversine_distance(r.lat1, r.lon1, r.lat2, r.lon2) :
+            vincenty_distance(r.lat1, r.lon1, r.lat2, r.lon2);
+        bool ok = std::abs(d - r.expected) <= r.tolerance;
+        printf("    %-28s %16.4f m  expected %16.4f m  %s\n", r.name, d, r.expected, ok ? "ok" : "FAIL");
+        result = result && ok;
+    }
+
+    double bearing = initial_bearing(0.0, 0.0, 1.0, 0.0);
+    bool bearing_ok = std::abs(bearing) < 1e-9;
+    printf("    %-28s %16.4f    expected %16.4f    %s\n", "bearing due north", bearing, 0.0, bearing_ok ? "ok" : "FAIL");
+
+    double bearing_west = initial_bearing(0.0, 0.0, 0.0, -1.0);
+    bool bearing_west_ok = std::abs(bearing_west - 270.0) < 1e-9;
+    printf("    %-28s %16.4f    expected %16.4f    %s\n", "bearing due west", bearing_west, 270.0, bearing_west_ok ? "ok" : "FAIL");
+
+    return result && bearing_ok && bearing_west_ok;
+}
+
+double angle_difference(double a, double b)
+{
+    // 359.9999999 and 0.0000001 are 2e-7 degrees apart, not 360
+    double d = std::fmod(std::abs(a - b), 360.0);
+    return std::min(d, 360.0 - d);
+}
+
+bool check_kernels_agree(const track& t)
+{
+    std::size_t segments = t.lat.size() - 1;
+
+    std::vector<double> scalar_distances(segments);
+    std::vector<double> simd_distances(segments);
+    std::vector<double> scalar_bearings(segments);
+    std::vector<double> simd_bearings(segments);
+
+    geodesy_options scalar_options;
+    scalar_options.kernel = geodesy_kernel::scalar;
+    scalar_options.execution = geodesy_execution::sequential;
+
+    geodesy_options simd_options;
+    simd_options.kernel = geodesy_kernel::simd;
+    simd_options.execution = geodesy_execution::parallel;
+
+    if (!try_compute_segment_distances(t.lat, t.lon, scalar_distances, scalar_options) ||
+        !try_compute_segment_distances(t.lat, t.lon, simd_distances, simd_options) ||
+        !try_compute_segment_bearings(t.lat, t.lon, scalar_bearings, scalar_options) ||
+        !try_compute_segment_bearings(t.lat, t.lon, simd_bearings, simd_options))
+    {
+        return false;
+    }
+
+    // The bearing of a very short segment is ill conditioned, an ulp of position error turns into
+    // an angle error of roughly R * 1e-16 / length radians, so only compare segments above a meter
+    const double min_bearing_distance = 1.0;
+
+    double max_distance_error = 0;
+    double max_bearing_error = 0;
+    std::size_t bearing_segments = 0;
+
+    for (std::size_t i = 0; i < segments; i++)
+    {
+        max_distance_error = std::max(max_distance_error, std::abs(scalar_distances[i] - simd_distances[i]));
+        if (scalar_distances[i] >= min_bearing_distance)
+        {
+            max_bearing_error = std::max(max_bearing_error, angle_difference(scalar_bearings[i], simd_bearings[i]));
+            bearing_segments++;
+        }
+    }
+
+    std::vector<double> odometer(t.lat.size());
+    if (!try_compute_odometer(t.lat, t.lon, odometer, simd_options))
+    {
+        return false;
+    }
+
+    double total = 0;
+    for (double d : scalar_distances)
+    {
+        total += d;
+    }
+
+    double odometer_error = std::abs(odometer.back() - total);
+
+    printf("    simd vs scalar max distance error: %.3e m\n", max_distance_error);
+    printf("    simd vs scalar max bearing error:  %.3e deg (%zu of %zu segments over %.0f m)\n",
+        max_bearing_error, bearing_segments, segments, min_bearing_distance);
+    printf("    odometer vs segment sum error:     %.3e m (total %.1f m)\n", odometer_error, total);
+
+    return max_distance_error < 1e-6 && max_bearing_error < 1e-6 && odometer_error < 1e-3;
+}
+
+double benchmark(const track& t, const geodesy_options& options, int iterations)
+{
+    std::vector<double> distances(t.lat.size() - 1);
+
+    // Warm up
+    try_compute_segment_distances(t.lat, t.lon, distances, options);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        try_compute_segment_distances(t.lat, t.lon, distances, options);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return (double)distances.size() * iterations / seconds;
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t count = 1 << 22;
+    int iterations = 10;
+
+    if (argc > 1)
+        count = std::max<std::size_t>(2, std::strtoull(argv[1], nullptr, 10));
+    if (argc > 2)
+        iterations = std::max(1, std::atoi(argv[2]));
+
+    printf("Reference values:\n");
+    bool references_ok = check_reference_values();
+
+    track t = make_random_track(count);
+
+    printf("\nKernel agreement (%zu points):\n", count);
+    bool kernels_ok = check_kernels_agree(t);
+
+    struct
+    {
+        const char* name;
+        geodesy_method method;
+        geodesy_kernel kernel;
+        geodesy_execution execution;
+    } runs[] =
+    {
+        { "haversine scalar",          geodesy_method::haversine, geodesy_kernel::scalar, geodesy_execution::sequential },
+        { "haversine simd",            geodesy_method::haversine, geodesy_kernel::simd,   geodesy_execution::sequential },
+        { "haversine scalar parallel", geodesy_method::haversine, geodesy_kernel::scalar, geodesy_execution::parallel },
+        { "haversine simd parallel",   geodesy_method::haversine, geodesy_kernel::simd,   geodesy_execution::parallel },
+        { "vincenty",                  geodesy_method::vincenty,  geodesy_kernel::scalar, geodesy_execution::sequential },
+        { "vincenty parallel",         geodesy_method::vincenty,  geodesy_kernel::scalar, geodesy_execution::parallel },
+    };
+
+    printf("\nThroughput (%d iterations, simd %s):\n", iterations, geodesy_simd_available() ? "available" : "not available");
+
+    for (const auto& run : runs)
+    {
+        geodesy_options options;
+        options.method = run.method;
+        options.kernel = run.kernel;
+        options.execution = run.execution;
+        double rate = benchmark(t, options, iterations);
+        printf("    %-28s %10.2f M segments/s\n", run.name, rate / 1e6);
+    }
+
+    return (references_ok && kernels_ok) ? 0 : 1;
+}
@@ -1,93 +1,64 @@
 ﻿
 #include "gps.h"
+#include "position_view.h"
 
 #include <gps.h>
 #include <unistd.h>
 
 #include <cmath>
+#include <cerrno>
 #include <ctime>
 #include <chrono>
-
-#define POSITION_LIB_NAMESPACE_BEGIN
-#define POSITION_LIB_NAMESPACE_END
-#define POSITION_LIB_DETAIL_NAMESPACE_BEGIN
-#define POSITION_LIB_DETAIL_NAMESPACE_REFERENCE
-#define POSITION_LIB_DETAIL_NAMESPACE_END
-#include "external/position.hpp"
+#include <fstream>
+#include <cstring>
 
 using namespace std;
 
-struct gpsd_client::gpsd_client_impl
+namespace
 {
-    gps_data_t gps_data;
-};
-
-gpsd_client::gpsd_client()
-{
-    impl = make_unique<gpsd_client_impl>();
-}
-
-gpsd_client::~gpsd_client() = default;
-
-bool gpsd_client::open(const string& hostname, int port)
-{
-    if (gps_open(hostname.c_str(), to_string(port).c_str(), &impl.get()->gps_data) != 0)
+    bool try_update_gnss_info(gps_data_t& gps_data, const std::timespec& receive_time, gnss_info& info, bool& position_set, bool& satellites_set, bool& time_set, bool& no_fix_set)
     {
-        return false;
-    }
-    gps_stream(&impl.get()->gps_data, WATCH_ENABLE | WATCH_JSON, nullptr);
-    return true;
-}
-
-void gpsd_client::close()
-{
-    gps_stream(&impl.get()->gps_data, WATCH_DISABLE, NULL);
-    gps_close(&impl.get()->gps_data);
-}
-
-bool gpsd_client::try_get_gps_info(gnss_info& info, gnss_include_info include_info)
-{
-    const char* mode_str[] =
-    {
-        "n/a",
-        "None",
-        "2D", 
-        "3D"
-    };
-
-    bool position_set = false;
-    bool satellites_set = false;
-    bool time_set = false;
-
-    auto start = std::chrono::high_resolution_clock::now();
-
-    while (true)
-    {
-        if (!gps_waiting(&impl.get()->gps_data, 100000))
+        const char* mode_str[] =
         {
-            continue;
-        }
+            "n/a",
+            "None",
+            "2D", 
+            "3D"
+        };
 
-        if (gps_read(&impl.get()->gps_data, NULL, 0) == -1)
+        if ((MODE_SET & gps_data.set) != MODE_SET)
         {
-            return false;
+            return true;
         }
 
-        if ((MODE_SET & impl.get()->gps_data.set) != MODE_SET)
+        if (gps_data.fix.mode < 0 || gps_data.fix.mode >= sizeof(mode_str))
         {
-            continue;
+            gps_data.fix.mode = 0;
         }
 
-        if (impl.get()->gps_data.fix.mode < 0 || impl.get()->gps_data.fix.mode >= sizeof(mode_str))
+        // The mode is reported with or without a position, so a lost fix is visible
+        switch (gps_data.fix.mode)
         {
-            impl.get()->gps_data.fix.mode = 0;
+            case 2:
+                info.mode = fix_mode::d2;
+                break;
+            case 3:
+                info.mode = fix_mode::d3;
+                break;
+            default:
+                info.mode = fix_mode::none;
+                no_fix_set = true;
+                break;
         }
 
-        if (TIME_SET == (TIME_SET & impl.get()->gps_data.set))
+        if (TIME_SET == (TIME_SET & gps_data.set))
         {
+            info.gps_time = gps_data.fix.time;
+            info.receive_time = receive_time;
+
             std::chrono::system_clock::time_point tp
             {
-                std::chrono::seconds(impl.get()->gps_data.fix.time.tv_sec) + std::chrono::nanoseconds(impl.get()->gps_data.fix.time.tv_nsec)
+                std::chrono::seconds(gps_data.fix.time.tv_sec) + std::chrono::nanoseconds(gps_data.fix.time.tv_nsec)
             };
 
             std::time_t time_t = std::chrono::system_clock::to_time_t(tp);
@@ -122,48 +93,109 @@ bool gpsd_client::try_get_gps_info(gnss_info& info, gnss_include_info include_in
             time_set = true;
         }
 
-        if (SATELLITE_SET == (SATELLITE_SET & impl.get()->gps_data.set))
+        if (SATELLITE_SET == (SATELLITE_SET & gps_data.set))
         {
-            info.satellites = impl.get()->gps_data.satellites_used;
+            info.satellites = gps_data.satellites_used;
             satellites_set = true;
         }       
 
-        if (isfinite(impl.get()->gps_data.fix.latitude) && isfinite(impl.get()->gps_data.fix.longitude))
+        if (isfinite(gps_data.fix.latitude) && isfinite(gps_data.fix.longitude))
+        {
+            info.lat = gps_data.fix.latitude;
+            info.lon = gps_data.fix.longitude;
+            info.speed = gps_data.fix.speed;
+            info.alt = gps_data.fix.altitude;
+            info.track = gps_data.fix.track;
+
+            auto sattelites = gps_data.satellites_visible; 
+            auto lat_error = gps_data.fix.epy;
+            auto lon_error = gps_data.fix.epx;            
+            auto speed_error = gps_data.fix.eps;
+
+            position_set = true;
+        }
+
+        return true;
+    }
+
+    bool has_gnss_info(gnss_include_info include_info, bool position_set, bool satellites_set, bool time_set, bool no_fix_set)
+    {
+        return (!enum_gnss_include_info_has_flag(include_info, gnss_include_info::position) || position_set ||
+                (enum_gnss_include_info_has_flag(include_info, gnss_include_info::no_fix) && no_fix_set)) &&
+            (!enum_gnss_include_info_has_flag(include_info, gnss_include_info::time) || time_set) &&
+            (!enum_gnss_include_info_has_flag(include_info, gnss_include_info::satellites) || satellites_set);
+    }
+}
+
+struct gpsd_client::gpsd_client_impl
+{
+    gps_data_t gps_data;
+};
+
+gpsd_client::gpsd_client()
+{
+    impl = make_unique<gpsd_client_impl>();
+}
+
+gpsd_client::~gpsd_client() = default;
+
+bool gpsd_client::open(const string& hostname, int port)
+{
+    if (gps_open(hostname.c_str(), to_string(port).c_str(), &impl.get()->gps_data) != 0)
+    {
+        return false;
+    }
+    gps_stream(&impl.get()->gps_data, WATCH_ENABLE | WATCH_JSON, nullptr);
+    return true;
+}
+
+void gpsd_client::close()
+{
+    gps_stream(&impl.get()->gps_data, WATCH_DISABLE, NULL);
+    gps_close(&impl.get()->gps_data);
+}
+
+bool gpsd_client::try_get_gps_info(gnss_info& info, gnss_include_info include_info, const volatile std::sig_atomic_t* stop)
+{
+    bool position_set = false;
+    bool satellites_set = false;
+    bool time_set = false;
+    bool no_fix_set = false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    while (true)
+    {
+        // Checked at least every 100 ms, also when there is no fix or gpsd sends nothing
+        if (stop != nullptr && *stop)
+        {
+            return false;
+        }
+
+        errno = 0;
+        if (!gps_waiting(&impl.get()->gps_data, 100000))
         {
-            info.lat = impl.get()->gps_data.fix.latitude;
-            info.lon = impl.get()->gps_data.fix.longitude;
-            info.speed = impl.get()->gps_data.fix.speed;
-            info.alt = impl.get()->gps_data.fix.altitude;
-            info.track = impl.get()->gps_data.fix.track;
-
-            auto sattelites = impl.get()->gps_data.satellites_visible; 
-            auto lat_error = impl.get()->gps_data.fix.epy;
-            auto lon_error = impl.get()->gps_data.fix.epx;            
-            auto speed_error = impl.get()->gps_data.fix.eps;
-
-            switch (impl.get()->gps_data.fix.mode)
+            if (errno == EINTR && stop != nullptr && *stop)
             {
-                case 0:
-                case 1:
-                    info.mode = fix_mode::none;
-                    break;
-                case 2:
-                    info.mode = fix_mode::d2;
-                    break;
-                case 3:
-                    info.mode = fix_mode::d3;
-                    break;
-                default:
-                    info.mode = fix_mode::none;
-                    break;
+                return false;
             }
+            continue;
+        }
 
-            position_set = true;
+        if (gps_read(&impl.get()->gps_data, NULL, 0) == -1)
+        {
+            return false;
+        }
+
+        std::timespec receive_time = {};
+        clock_gettime(CLOCK_REALTIME, &receive_time);
+
+        if (!try_update_gnss_info(impl.get()->gps_data, receive_time, info, position_set, satellites_set, time_set, no_fix_set))
+        {
+            return false;
         }
        
-        if ((!enum_gnss_include_info_has_flag(include_info, gnss_include_info::position) || position_set) &&
-            (!enum_gnss_include_info_has_flag(include_info, gnss_include_info::time) || time_set) &&
-            (!enum_gnss_include_info_has_flag(include_info, gnss_include_info::satellites) || satellites_set))
+        if (has_gnss_info(include_info, position_set, satellites_set, time_set, no_fix_set))
         {
             auto end = std::chrono::high_resolution_clock::now();
             info.duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -187,21 +219,96 @@ bool gpsd_client::try_get_gps_position_and_time(double& lat, double& lon, struct
     return false;
 }
 
+struct gpsd_log_reader::gpsd_log_reader_impl
+{
+    gps_data_t gps_data;
+    std::ifstream file;
+    std::string line;
+};
+
+gpsd_log_reader::gpsd_log_reader()
+{
+    impl = make_unique<gpsd_log_reader_impl>();
+}
+
+gpsd_log_reader::~gpsd_log_reader() = default;
+
+bool gpsd_log_reader::open(const string& filename)
+{
+    impl.get()->file.open(filename);
+    if (!impl.get()->file)
+    {
+        return false;
+    }
+    std::memset(&impl.get()->gps_data, 0, sizeof(impl.get()->gps_data));
+    return true;
+}
+
+void gpsd_log_reader::close()
+{
+    impl.get()->file.close();
+}
+
+bool gpsd_log_reader::try_get_gps_info(gnss_info& info, gnss_include_info include_info)
+{
+    bool position_set = false;
+    bool satellites_set = false;
+    bool time_set = false;
+    bool no_fix_set = false;
+
+    while (std::getline(impl.get()->file, impl.get()->line))
+    {
+        // Each line is one gpsd JSON report, as recorded with gpspipe -w
+        if (impl.get()->line.empty() || impl.get()->line[0] != '{')
+        {
+            continue;
+        }
+
+        impl.get()->gps_data.set = 0;
+        if (gps_unpack(impl.get()->line.c_str(), &impl.get()->gps_data) != 0)
+        {
+            continue;
+        }
+
+        std::timespec receive_time = {};
+        clock_gettime(CLOCK_REALTIME, &receive_time);
+
+        if (!try_update_gnss_info(impl.get()->gps_data, receive_time, info, position_set, satellites_set, time_set, no_fix_set))
+        {
+            return false;
+        }
+
+        if (has_gnss_info(include_info, position_set, satellites_set, time_set, no_fix_set))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 std::string to_json(const gnss_info& info)
 {
+    return to_json(position_view(info));
+}
+
+std::string to_json(const position_view& view)
+{
+    const gnss_info& info = view.info();
+
     std::string str;
 
     str += "{\n";
     
     // DD    
-    position_dd dd(info.lat, info.lon);
+    const position_dd& dd = view.dd();
     str += "    \"position_dd\": {\n";
     str += "        \"lat\": \"" + std::to_string(dd.lat) + "\",\n";
     str += "        \"lon\": \"" + std::to_string(dd.lon) + "\"\n";
     str += "    },\n";
 
     // DDM
-    position_ddm ddm = dd;
+    const position_ddm& ddm = view.ddm();
     str += "    \"position_ddm\": {\n";
     str += "        \"lat\": \"" + std::string(1, ddm.lat) + "\",\n";
     str += "        \"lat_d\": \"" + std::to_string(ddm.lat_d) + "\",\n";
@@ -212,7 +319,7 @@ std::string to_json(const gnss_info& info)
     str += "    },\n";
 
     // DMS
-    position_dms dms = dd;
+    const position_dms& dms = view.dms();
     str += "    \"position_dms\": {\n";
     str += "        \"lat\": \"" + std::string(1, dms.lat) + "\",\n";
     str += "        \"lat_d\": \"" + std::to_string(dms.lat_d) + "\",\n";
@@ -225,7 +332,7 @@ std::string to_json(const gnss_info& info)
     str += "    },\n";
 
     // DDM in ddmm.mmN/dddmm.mmE notation used by APRX
-    position_display_string pos_display = format(ddm, position_ddm_short_format);
+    const position_display_string& pos_display = view.ddm_short_display();
     str += "    \"position_ddm_short\": {\n";
     str += "        \"lat\": \"" + pos_display.lat + "\",\n";
     str += "        \"lon\": \"" + pos_display.lon + "\"\n";
@@ -3,6 +3,8 @@
 #include <string>
 #include <memory>
 #include <limits>
+#include <ctime>
+#include <csignal>
 
 struct date_time
 {
@@ -30,13 +32,18 @@ struct gnss_info
     double track = std::numeric_limits<double>::quiet_NaN();
     date_time time_utc;
     date_time time;
+    std::timespec gps_time = {};     // fix time as reported by the receiver
+    std::timespec receive_time = {}; // local CLOCK_REALTIME when the fix time was read from gpsd
     int age = -1;
     fix_mode mode = fix_mode::none;
     int satellites = 0;
     int duration = 0;
 };
 
+class position_view;
+
 std::string to_json(const gnss_info& info);
+std::string to_json(const position_view& view);
 
 enum class gnss_include_info : int
 {
@@ -44,6 +51,7 @@ enum class gnss_include_info : int
     position = 1,
     satellites = 2,
     time = 4,
+    no_fix = 8, // with position, also return reports without a fix, they carry the mode but no position
     all = position | satellites | time
 };
 
@@ -72,8 +80,25 @@ public:
     bool open(const std::string& hostname = "localhost", int port = 2947);
     void close();
     bool try_get_gps_position_and_time(double& lat, double& lon, struct date_time& time_utc);
-    bool try_get_gps_info(gnss_info& info, gnss_include_info include_info);
+    // Returns false as soon as *stop becomes non zero, e.g. set from a signal handler
+    bool try_get_gps_info(gnss_info& info, gnss_include_info include_info, const volatile std::sig_atomic_t* stop = nullptr);
 private:
     struct gpsd_client_impl;
     std::unique_ptr<gpsd_client_impl> impl;
 };
+
+// Replays gpsd JSON reports recorded with gpspipe -w
+class gpsd_log_reader
+{
+public:
+    gpsd_log_reader();
+    ~gpsd_log_reader();
+    gpsd_log_reader(const gpsd_log_reader&) = delete;
+    gpsd_log_reader& operator=(const gpsd_log_reader&) = delete;
+    bool open(const std::string& filename);
+    void close();
+    bool try_get_gps_info(gnss_info& info, gnss_include_info include_info);
+private:
+    struct gpsd_log_reader_impl;
+    std::unique_ptr<gpsd_log_reader_impl> impl;
+};
@@ -1,4 +1,10 @@
 #include "gps.h"
+#include "output_template.h"
+#include "ntp_shm.h"
+#include "output_filter.h"
+#include "track_exporter.h"
+#include "position_view.h"
+#include "state_file.h"
 
 #include <cxxopts.hpp>
 #include <fmt/format.h>
@@ -9,13 +15,11 @@
 #include <sstream>
 #include <string>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
 
-#define POSITION_LIB_NAMESPACE_BEGIN
-#define POSITION_LIB_NAMESPACE_END
-#define POSITION_LIB_DETAIL_NAMESPACE_BEGIN
-#define POSITION_LIB_DETAIL_NAMESPACE_REFERENCE
-#define POSITION_LIB_DETAIL_NAMESPACE_END
-#include "external/position.hpp"
+#include <signal.h>
 
 using namespace std;
 
@@ -56,6 +60,17 @@ struct args
     std::string aprs_comment;
     std::string aprs_symbol;
     std::string aprs_symbol_table;
+    std::string template_string;
+    output_template print_template;
+    int ntp_shm_unit = -1;
+    int ntp_shm_read_unit = -1;
+    bool watch = false;
+    output_filter_options filter_options;
+    std::string export_file;
+    track_format export_format = track_format::gpx;
+    std::string replay_file;
+    state_file_options state_options;
+    std::string state_file_read;
 };
 
 bool try_parse_command_line(int argc, char* argv[], args& args);
@@ -66,17 +81,32 @@ bool try_parse_double(std::string str, double& number);
 
 position_print_format parse_position_format(const std::string& pos_str);
 
-void print_position(position_format format, const gnss_info& gnss_info);
-int write_position(const std::string& filename, const gnss_info& info);
+void print_position(position_print_format print_fmt, const gnss_info& gnss_info);
+void print_position(position_print_format print_fmt, const position_view& view);
+int write_position(state_file_writer& state_file, const position_view& view);
 std::string encode_aprs_position_packet_no_timestamp(const std::string& symbol, const std::string& symbol_table, const std::string& comment, double lat, double lon);
+std::string encode_aprs_position_packet_no_timestamp(const std::string& symbol, const std::string& symbol_table, const std::string& comment, const position_view& view);
 std::string encode_aprs_position_packet_no_timestamp(const args& args, double lat, double lon);
 std::string encode_aprs_position_packet_no_timestamp(const args& args);
+std::string encode_aprs_position_packet_no_timestamp(const args& args, const position_view& view);
 std::string encode_aprs_position_packet(const std::string& symbol, const std::string& symbol_table, const std::string& comment, const gnss_info& gnss_info);
+std::string encode_aprs_position_packet(const std::string& symbol, const std::string& symbol_table, const std::string& comment, const position_view& view);
 std::string encode_aprs_position_packet(const args& args, const gnss_info& gnss_info);
+std::string encode_aprs_position_packet(const args& args, const position_view& view);
 void print_aprs_position_packet(const args& args, const gnss_info& gnss_info);
+void print_aprs_position_packet(const args& args, const position_view& view);
+void print_template_position(const output_template& tmpl, const position_view& view, std::string& buffer);
 std::string format_two_digits_string(int number);
 
+int output_position(const args& args, const gnss_info& info, std::string& buffer, state_file_writer& state_file);
+
 bool try_get_gps_info(const args& args, gnss_info& info);
+int run_ntp_shm(const args& args);
+int run_ntp_shm_read(const args& args);
+int run_state_file_read(const args& args);
+int run_watch(const args& args);
+void handle_stop_signal(int /*signal*/);
+void install_stop_signal_handlers();
 
 int main(int argc, char* argv[]);
 
@@ -100,6 +130,7 @@ bool try_parse_command_line(int argc, char* argv[], args& args)
         .add_options()
         ("o,output", "", cxxopts::value<std::string>())
         ("f,format", "", cxxopts::value<std::string>()->default_value("dd"))
+        ("t,template", "", cxxopts::value<std::string>())
         ("p,port", "", cxxopts::value<int>())
         ("h,host-name", "", cxxopts::value<std::string>())
         ("aprs-comment", "", cxxopts::value<std::string>())
@@ -108,6 +139,20 @@ bool try_parse_command_line(int argc, char* argv[], args& args)
         ("lat", "", cxxopts::value<std::string>())
         ("lon", "", cxxopts::value<std::string>())
         ("use-gps", "", cxxopts::value<std::string>())
+        ("ntp-shm", "", cxxopts::value<int>())
+        ("ntp-shm-read", "", cxxopts::value<int>())
+        ("w,watch", "")
+        ("min-distance", "", cxxopts::value<std::string>())
+        ("min-heading-change", "", cxxopts::value<std::string>())
+        ("min-interval", "", cxxopts::value<std::string>())
+        ("max-interval", "", cxxopts::value<std::string>())
+        ("emit-on-mode-change", "", cxxopts::value<std::string>())
+        ("export", "", cxxopts::value<std::string>())
+        ("export-format", "", cxxopts::value<std::string>())
+        ("replay", "", cxxopts::value<std::string>())
+        ("state-file", "", cxxopts::value<std::string>())
+        ("state-file-interval", "", cxxopts::value<std::string>())
+        ("state-file-read", "", cxxopts::value<std::string>())
         ("no-gps", "")
         ("help", "")
         ("no-stdout", "");
@@ -129,6 +174,17 @@ bool try_parse_command_line(int argc, char* argv[], args& args)
         args.output_file = result["output"].as<std::string>();
     if (result.count("format") > 0)
         args.format = parse_position_format(result["format"].as<std::string>());
+    if (result.count("template") > 0)
+    {
+        args.template_string = result["template"].as<std::string>();
+        std::string error;
+        if (!try_parse_output_template(args.template_string, args.print_template, error))
+        {
+            args.command_line_error = fmt::format("Error parsing template: {}", error);
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
     if (result.count("port") > 0)
         args.port = result["port"].as<int>();
     if (result.count("host-name") > 0)
@@ -171,6 +227,116 @@ bool try_parse_command_line(int argc, char* argv[], args& args)
         args.aprs_symbol = result["aprs-symbol"].as<std::string>();
     if (result.count("aprs-symbol-table-id") > 0)
         args.aprs_symbol_table = result["aprs-symbol-table-id"].as<std::string>();
+    if (result.count("ntp-shm") > 0)
+    {
+        args.ntp_shm_unit = result["ntp-shm"].as<int>();
+        if (args.ntp_shm_unit < 0)
+        {
+            args.command_line_error = fmt::format("Invalid NTP SHM unit: {}", args.ntp_shm_unit);
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("ntp-shm-read") > 0)
+    {
+        args.ntp_shm_read_unit = result["ntp-shm-read"].as<int>();
+        if (args.ntp_shm_read_unit < 0)
+        {
+            args.command_line_error = fmt::format("Invalid NTP SHM unit: {}", args.ntp_shm_read_unit);
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("watch") > 0)
+        args.watch = true;
+    if (result.count("min-distance") > 0)
+    {
+        if (!try_parse_double(result["min-distance"].as<std::string>(), args.filter_options.min_distance))
+        {
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("min-heading-change") > 0)
+    {
+        if (!try_parse_double(result["min-heading-change"].as<std::string>(), args.filter_options.min_heading_change))
+        {
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("min-interval") > 0)
+    {
+        if (!try_parse_double(result["min-interval"].as<std::string>(), args.filter_options.min_interval))
+        {
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("max-interval") > 0)
+    {
+        if (!try_parse_double(result["max-interval"].as<std::string>(), args.filter_options.max_interval))
+        {
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (args.filter_options.max_interval > 0 && args.filter_options.max_interval < args.filter_options.min_interval)
+    {
+        args.command_line_error = fmt::format("--max-interval {} is smaller than --min-interval {}", args.filter_options.max_interval, args.filter_options.min_interval);
+        args.command_line_has_errors = true;
+        return false;
+    }
+    if (result.count("emit-on-mode-change") > 0)
+    {
+        if (!try_parse_bool(result["emit-on-mode-change"].as<std::string>(), args.filter_options.fix_mode_change))
+        {
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("export") > 0)
+    {
+        args.export_file = result["export"].as<std::string>();
+        // Format defaults to the file extension, GPX otherwise
+        try_get_track_format_from_filename(args.export_file, args.export_format);
+    }
+    if (result.count("export-format") > 0)
+    {
+        if (!try_parse_track_format(to_lower(result["export-format"].as<std::string>()), args.export_format))
+        {
+            args.command_line_error = fmt::format("Invalid export format: {}", result["export-format"].as<std::string>());
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("replay") > 0)
+        args.replay_file = result["replay"].as<std::string>();
+    if (args.no_gps && (!args.export_file.empty() || !args.replay_file.empty()))
+    {
+        args.command_line_error = "--export and --replay cannot be used with --no-gps";
+        args.command_line_has_errors = true;
+        return false;
+    }
+    if (result.count("state-file") > 0)
+    {
+        if (!try_parse_state_file_strategy(to_lower(result["state-file"].as<std::string>()), args.state_options.strategy))
+        {
+            args.command_line_error = fmt::format("Invalid state file strategy: {}", result["state-file"].as<std::string>());
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
+    if (result.count("state-file-read") > 0)
+        args.state_file_read = result["state-file-read"].as<std::string>();
+    if (result.count("state-file-interval") > 0)
+    {
+        if (!try_parse_double(result["state-file-interval"].as<std::string>(), args.state_options.min_interval))
+        {
+            args.command_line_has_errors = true;
+            return false;
+        }
+    }
 
     return true;
 }
@@ -194,6 +360,14 @@ void print_usage()
         "                                     ddm_short\n"
         "                                     aprx\n"
         "                                     aprs\n"
+        "    -t, --template <template>    custom output line, overrides --format, fields:\n"
+        "                                     {lat} {lon} {alt} {speed} {track} {satellites}\n"
+        "                                         with optional [[fill]align][sign][0][width][.precision][type]\n"
+        "                                         spec, type f, e or g, d for satellites, e.g. {speed:.1f}\n"
+        "                                     {lat_dd} {lat_ddm} {lat_dms} {lat_ddm_short}\n"
+        "                                     {lon_dd} {lon_ddm} {lon_dms} {lon_ddm_short}\n"
+        "                                     {mode}\n"
+        "                                     {utc} {time} with optional strftime spec, e.g. {utc:%H%M%S}\n"
         "    --aprs-comment <comment>     APRS comment\n"
         "    --aprs-symbol <symbol>       APRS symbol\n"
         "    --aprs-symbol-table-id <id>  APRS symbol table\n"
@@ -201,6 +375,27 @@ void print_usage()
         "    --no-gps                     use fixed input lat,lon as information\n"
         "    --lat <lat>                  fixed latitude in DD format\n"
         "    --lon <lon>                  fixed longitude in DD format\n"
+        "    --ntp-shm <unit>             continuously write GPS time to the NTP SHM(unit) refclock, 2D/3D fixes only\n"
+        "    --ntp-shm-read <unit>        print the current sample of the NTP SHM(unit) refclock\n"
+        "    -w, --watch                  continuously print and write fixes as they arrive\n"
+        "    --min-distance <m>           watch: only emit after moving at least this many meters\n"
+        "    --min-heading-change <deg>   watch: only emit after the track changed by this many degrees,\n"
+        "                                 only checked while moving faster than 0.5 m/s\n"
+        "    --min-interval <s>           watch: emit at most once every this many seconds\n"
+        "    --max-interval <s>           watch: emit at least once every this many seconds\n"
+        "    --emit-on-mode-change <bool> watch: emit when the fix mode changes, including a lost fix, default true\n"
+        "    --export <file>              stream the track to a GPX, GeoJSON or KML file, implies --watch\n"
+        "    --export-format <format>     gpx, geojson or kml, defaults to the --export file extension\n"
+        "    --replay <file>              read fixes from a gpsd JSON log (gpspipe -w) instead of gpsd\n"
+        "    --state-file <strategy>      how -o is updated:\n"
+        "                                     direct - truncate and rewrite, the default\n"
+        "                                     rename - write a temporary file and rename it\n"
+        "                                     mmap   - update a preallocated file in place,\n"
+        "                                              header with a generation counter,\n"
+        "                                              -o is binary, not plain JSON, read it\n"
+        "                                              with --state-file-read\n"
+        "    --state-file-interval <s>    rename: write at most once every this many seconds, default 1\n"
+        "    --state-file-read <file>     print the JSON of a state file written with --state-file mmap\n"
         "    --help                       print usage\n"
         "    --no-stdout                  no stdout\n"
         "\n"
@@ -210,6 +405,15 @@ void print_usage()
         "\n"
         "Example:\n"
         "    gps_util -h localhost -p 8888 -f dms -o file.json\n"
+        "    gps_util -h localhost -p 2947 --ntp-shm 2\n"
+        "    gps_util --ntp-shm-read 2\n"
+        "    gps_util -h localhost -p 2947 --export trip.gpx --no-stdout\n"
+        "    gps_util --replay gpspipe.log --export trip.geojson --no-stdout\n"
+        "    gps_util -h localhost -p 2947 -w -o /run/gps.json --state-file rename --state-file-interval 10\n"
+        "    gps_util -h localhost -p 2947 -w -o /run/gps.state --state-file mmap\n"
+        "    gps_util --state-file-read /run/gps.state\n"
+        "    gps_util -h localhost -p 2947 -w -o file.json --min-distance 10 --min-heading-change 15 --max-interval 300\n"
+        "    gps_util -h localhost -p 8888 -t \"{utc:%H%M%S} {lat_ddm_short} {lon_ddm_short} {speed:.1f}\"\n"
         "    gps_util -h localhost -p 8888 -f aprs --aprs-comment \"Downtown Bellevue fill-in Digipeater\" --aprs-symbol \"#\" --aprs-symbol-table-id \"I\"\n"
         "\n"
         "\n";
@@ -273,43 +477,37 @@ position_print_format parse_position_format(const std::string& pos_str)
 
 void print_position(position_print_format print_fmt, const gnss_info& gnss_info)
 {
-    position_dd dd = { gnss_info.lat, gnss_info.lon };
-    position_display_string pos_display;
+    print_position(print_fmt, position_view(gnss_info));
+}
 
-    if (print_fmt == position_print_format::dd)
-    {
-        pos_display = format(dd, position_dd_format);
-    }
-    else if (print_fmt == position_print_format::ddm)
+void print_position(position_print_format print_fmt, const position_view& view)
+{
+    // Points at the view's cached strings, no per print copies
+    const position_display_string* pos_display = nullptr;
+
+    if (print_fmt == position_print_format::ddm)
     {
-        pos_display = format(position_ddm(dd), position_ddm_format);
+        pos_display = &view.ddm_display();
     }
     else if (print_fmt == position_print_format::dms)
     {
-        pos_display = format(position_dms(dd), position_dms_format);
+        pos_display = &view.dms_display();
     }
     else if (print_fmt == position_print_format::ddm_short)
     {
-        pos_display = format(position_ddm(dd), position_ddm_short_format);
+        pos_display = &view.ddm_short_display();
     }
-
-    printf("%s, %s\n", pos_display.lat.c_str(), pos_display.lon.c_str());
-}
-
-int write_position(const std::string& filename, const gnss_info& info)
-{
-    std::string json = to_json(info);
-
-    std::ofstream output_file(filename);
-    if (!output_file)
+    else
     {
-        return 1;
+        pos_display = &view.dd_display();
     }
 
-    output_file << json;
-    output_file.close();
+    printf("%s, %s\n", pos_display->lat.c_str(), pos_display->lon.c_str());
+}
 
-    return 0;
+int write_position(state_file_writer& state_file, const position_view& view)
+{
+    return state_file.write(to_json(view)) ? 0 : 1;
 }
 
 std::string encode_aprs_position_packet_no_timestamp(const std::string& symbol, const std::string& symbol_table, const std::string& comment, double lat, double lon) 
@@ -329,8 +527,16 @@ std::string encode_aprs_position_packet_no_timestamp(const std::string& symbol,
     //    !49  .  N/072  .  W-
     //
 
-    position_dd dd { lat, lon };
-    position_display_string ddm_short_display = format(position_ddm(dd), position_ddm_short_format);
+    gnss_info info;
+    info.lat = lat;
+    info.lon = lon;
+
+    return encode_aprs_position_packet_no_timestamp(symbol, symbol_table, comment, position_view(info));
+}
+
+std::string encode_aprs_position_packet_no_timestamp(const std::string& symbol, const std::string& symbol_table, const std::string& comment, const position_view& view)
+{
+    const position_display_string& ddm_short_display = view.ddm_short_display();
 
     std::string message;
 
@@ -354,6 +560,11 @@ std::string encode_aprs_position_packet_no_timestamp(const args& args)
     return encode_aprs_position_packet_no_timestamp(args.aprs_symbol, args.aprs_symbol_table, args.aprs_comment, args.lat, args.lon);
 }
 
+std::string encode_aprs_position_packet_no_timestamp(const args& args, const position_view& view)
+{
+    return encode_aprs_position_packet_no_timestamp(args.aprs_symbol, args.aprs_symbol_table, args.aprs_comment, view);
+}
+
 std::string encode_aprs_position_packet(const std::string& symbol, const std::string& symbol_table, const std::string& comment, const gnss_info& gnss_info) 
 {
     // 
@@ -370,8 +581,13 @@ std::string encode_aprs_position_packet(const std::string& symbol, const std::st
     //    @092345/4903.50N/07201.75W>Test1234
     //
 
-    position_dd dd { gnss_info.lat, gnss_info.lon };
-    position_display_string ddm_short_display = format(position_ddm(dd), position_ddm_short_format);
+    return encode_aprs_position_packet(symbol, symbol_table, comment, position_view(gnss_info));
+}
+
+std::string encode_aprs_position_packet(const std::string& symbol, const std::string& symbol_table, const std::string& comment, const position_view& view)
+{
+    const gnss_info& gnss_info = view.info();
+    const position_display_string& ddm_short_display = view.ddm_short_display();
 
     std::string message;
 
@@ -394,14 +610,31 @@ std::string encode_aprs_position_packet(const args& args, const gnss_info& gnss_
     return encode_aprs_position_packet(args.aprs_symbol, args.aprs_symbol_table, args.aprs_comment, gnss_info);
 }
 
+std::string encode_aprs_position_packet(const args& args, const position_view& view)
+{
+    return encode_aprs_position_packet(args.aprs_symbol, args.aprs_symbol_table, args.aprs_comment, view);
+}
+
 void print_aprs_position_packet(const args& args, const gnss_info& gnss_info)
 {
+    print_aprs_position_packet(args, position_view(gnss_info));
+}
+
+void print_aprs_position_packet(const args& args, const position_view& view)
+{
+    // With --no-gps the view is over the fixed --lat/--lon
     std::string packet = (args.no_gps || args.format == position_print_format::aprs_without_timestamp) ?
-        encode_aprs_position_packet_no_timestamp(args) :
-        encode_aprs_position_packet(args, gnss_info);
+        encode_aprs_position_packet_no_timestamp(args, view) :
+        encode_aprs_position_packet(args, view);
     printf("%s\n", packet.c_str());
 }
 
+void print_template_position(const output_template& tmpl, const position_view& view, std::string& buffer)
+{
+    render_output_template(tmpl, view, buffer);
+    printf("%s\n", buffer.c_str());
+}
+
 std::string format_two_digits_string(int number)
 {
     std::ostringstream oss;
@@ -409,6 +642,34 @@ std::string format_two_digits_string(int number)
     return oss.str();
 }
 
+int output_position(const args& args, const gnss_info& info, std::string& buffer, state_file_writer& state_file)
+{
+    // One view per fix, shared by every enabled output
+    position_view view(info);
+
+    if (!args.no_stdout)
+    {
+        if (!args.template_string.empty())
+        {
+            print_template_position(args.print_template, view, buffer);
+        }
+        else if (args.format == position_print_format::aprs_with_timestamp ||
+            args.format == position_print_format::aprs_without_timestamp)
+        {
+            print_aprs_position_packet(args, view);
+        }
+        else
+        {
+            print_position(args.format, view);
+        }
+    }
+    if (!args.output_file.empty())
+    {
+        return write_position(state_file, view);
+    }
+    return 0;
+}
+
 bool try_get_gps_info(const args& args, gnss_info& info)
 {
     gpsd_client s;
@@ -434,6 +695,279 @@ bool try_get_gps_info(const args& args, gnss_info& info)
     return result;
 }
 
+int run_ntp_shm(const args& args)
+{
+    ntp_shm_writer writer;
+    if (!writer.open(args.ntp_shm_unit))
+    {
+        if (!args.no_stdout)
+        {
+            printf("Error opening NTP SHM(%d) segment\n", args.ntp_shm_unit);
+        }
+        return 1;
+    }
+
+    gpsd_client s;
+    if (!s.open(args.host_name, args.port))
+    {
+        return 1;
+    }
+
+    std::timespec last_gps_time = {};
+
+    // Like gpsd's own SHM writer, wait for a few consecutive fixes before trusting the receiver time
+    const int min_good_fixes = 3;
+    int good_fixes = 0;
+
+    while (true)
+    {
+        gnss_info info;
+        if (!s.try_get_gps_info(info, gnss_include_info::position | gnss_include_info::time | gnss_include_info::no_fix))
+        {
+            break;
+        }
+
+        // Without a fix the time is the receiver RTC, never publish it as leap 0 (synchronised)
+        if ((info.mode != fix_mode::d2 && info.mode != fix_mode::d3) || info.gps_time.tv_sec <= 0)
+        {
+            good_fixes = 0;
+            continue;
+        }
+
+        // gpsd reports the same fix time in several messages, only write each sample once
+        if (info.gps_time.tv_sec == last_gps_time.tv_sec && info.gps_time.tv_nsec == last_gps_time.tv_nsec)
+        {
+            continue;
+        }
+        last_gps_time = info.gps_time;
+
+        if (good_fixes < min_good_fixes)
+        {
+            good_fixes++;
+            continue;
+        }
+
+        ntp_shm_sample sample;
+        sample.clock_time = info.gps_time;
+        sample.receive_time = info.receive_time;
+
+        if (!writer.write(sample))
+        {
+            break;
+        }
+
+        if (!args.no_stdout)
+        {
+            const ntp_shm_stats& stats = writer.stats();
+            printf("%lld.%09ld %lld.%09ld latency %.3f us, min %.3f us, max %.3f us, mean %.3f us\n",
+                (long long)sample.clock_time.tv_sec, (long)sample.clock_time.tv_nsec,
+                (long long)sample.receive_time.tv_sec, (long)sample.receive_time.tv_nsec,
+                stats.last_latency_ns / 1000.0, stats.min_latency_ns / 1000.0, stats.max_latency_ns / 1000.0,
+                stats.total_latency_ns / 1000.0 / stats.samples);
+        }
+    }
+
+    s.close();
+
+    return 1;
+}
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void handle_stop_signal(int /*signal*/)
+{
+    stop_requested = 1;
+}
+
+void install_stop_signal_handlers()
+{
+    // The gpsd client polls stop_requested, so the loop ends and the output files are closed
+    struct sigaction action = {};
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+
+int run_watch(const args& args)
+{
+    gpsd_client client;
+    gpsd_log_reader log_reader;
+    bool replay = !args.replay_file.empty();
+
+    if (replay ? !log_reader.open(args.replay_file) : !client.open(args.host_name, args.port))
+    {
+        return 1;
+    }
+
+    track_exporter exporter;
+    bool exporting = !args.export_file.empty();
+
+    if (exporting && !exporter.open(args.export_file, args.export_format))
+    {
+        if (replay)
+            log_reader.close();
+        else
+            client.close();
+        return 1;
+    }
+
+    state_file_writer state_file;
+
+    if (!args.output_file.empty() && !state_file.open(args.output_file, args.state_options))
+    {
+        if (exporting)
+            exporter.close();
+        if (replay)
+            log_reader.close();
+        else
+            client.close();
+        return 1;
+    }
+
+    install_stop_signal_handlers();
+
+    output_filter filter(args.filter_options);
+    std::string buffer;
+    gnss_info last_fix;
+    bool has_fix = false;
+    int result = 1;
+
+    // No fix reports are included so that losing and regaining a fix reaches the filter
+    gnss_include_info include_info = gnss_include_info::position | gnss_include_info::time | gnss_include_info::no_fix;
+
+    while (!stop_requested)
+    {
+        gnss_info info;
+        bool has_info = replay ?
+            log_reader.try_get_gps_info(info, include_info) :
+            client.try_get_gps_info(info, include_info, &stop_requested);
+
+        if (!has_info)
+        {
+            // Reaching the end of a recorded log or a stop request is a normal end
+            result = (replay || stop_requested) ? 0 : 1;
+            break;
+        }
+
+        // Recorded logs are filtered on fix time, live feeds on arrival time
+        std::chrono::steady_clock::time_point now = replay ?
+            std::chrono::steady_clock::time_point(std::chrono::seconds(info.gps_time.tv_sec) + std::chrono::nanoseconds(info.gps_time.tv_nsec)) :
+            std::chrono::steady_clock::now();
+
+        // Coalesced state file contents are written once their interval passes, even when
+        // the filter drops every following fix
+        if (!state_file.poll())
+        {
+            break;
+        }
+
+        // A no fix report has no position, it is reported at the last known one
+        bool no_fix = !std::isfinite(info.lat) || !std::isfinite(info.lon);
+        if (no_fix)
+        {
+            if (!has_fix)
+            {
+                continue;
+            }
+            info.lat = last_fix.lat;
+            info.lon = last_fix.lon;
+            info.alt = last_fix.alt;
+        }
+        else
+        {
+            last_fix = info;
+            has_fix = true;
+        }
+
+        // Only fixes that pass the filter are formatted and written
+        if (!filter.accept(info, now))
+        {
+            continue;
+        }
+
+        // The track only contains real positions
+        if (exporting && !no_fix && !exporter.write(info))
+        {
+            break;
+        }
+
+        if (output_position(args, info, buffer, state_file) != 0)
+        {
+            break;
+        }
+
+        fflush(stdout);
+    }
+
+    if (stop_requested)
+    {
+        result = 0;
+    }
+
+    if (exporting && !exporter.close())
+    {
+        result = 1;
+    }
+
+    // Flushes the last coalesced write
+    if (!args.output_file.empty() && !state_file.close())
+    {
+        result = 1;
+    }
+
+    if (replay)
+        log_reader.close();
+    else
+        client.close();
+
+    return result;
+}
+
+int run_ntp_shm_read(const args& args)
+{
+    ntp_shm_sample sample;
+    if (!try_read_ntp_shm(args.ntp_shm_read_unit, sample))
+    {
+        if (!args.no_stdout)
+        {
+            printf("No valid sample in NTP SHM(%d) segment\n", args.ntp_shm_read_unit);
+        }
+        return 1;
+    }
+
+    if (!args.no_stdout)
+    {
+        printf("clock %lld.%09ld receive %lld.%09ld leap %d precision %d\n",
+            (long long)sample.clock_time.tv_sec, (long)sample.clock_time.tv_nsec,
+            (long long)sample.receive_time.tv_sec, (long)sample.receive_time.tv_nsec,
+            sample.leap, sample.precision);
+    }
+
+    return 0;
+}
+
+int run_state_file_read(const args& args)
+{
+    std::string contents;
+    if (!try_read_state_file(args.state_file_read, contents))
+    {
+        if (!args.no_stdout)
+        {
+            printf("No valid contents in state file %s\n", args.state_file_read.c_str());
+        }
+        return 1;
+    }
+
+    if (!args.no_stdout)
+    {
+        printf("%s\n", contents.c_str());
+    }
+
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     args args;
@@ -456,28 +990,45 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    if (args.ntp_shm_unit >= 0)
+    {
+        return run_ntp_shm(args);
+    }
+
+    if (args.ntp_shm_read_unit >= 0)
+    {
+        return run_ntp_shm_read(args);
+    }
+
+    if (!args.state_file_read.empty())
+    {
+        return run_state_file_read(args);
+    }
+
+    if ((args.watch || !args.export_file.empty() || !args.replay_file.empty()) && !args.no_gps)
+    {
+        return run_watch(args);
+    }
+
     gnss_info info;
 
     if (try_get_gps_info(args, info))
     {
-        if (!args.no_stdout)
+        state_file_writer state_file;
+        if (!args.output_file.empty() && !state_file.open(args.output_file, args.state_options))
         {
-            if (args.format == position_print_format::aprs_with_timestamp || 
-                args.format == position_print_format::aprs_without_timestamp)
-            {
-                print_aprs_position_packet(args, info);
-            }
-            else
-            {
-                print_position(args.format, info);
-            }
+            return 1;
         }
-        if (!args.output_file.empty())
+
+        std::string buffer;
+        int result = output_position(args, info, buffer, state_file);
+
+        if (!args.output_file.empty() && !state_file.close())
         {
-            return write_position(args.output_file, info);
+            result = 1;
         }
 
-        return 0;
+        return result;
     }
 
     return 1;
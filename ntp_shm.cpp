@@ -0,0 +1,181 @@
+
+#include "ntp_shm.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+// Layout shared with ntpd (refclock_shm.c), chrony and gpsd, must not change
+struct ntp_shm_time
+{
+    int mode;
+    volatile int count;
+    time_t clock_time_stamp_sec;
+    int clock_time_stamp_usec;
+    time_t receive_time_stamp_sec;
+    int receive_time_stamp_usec;
+    int leap;
+    int precision;
+    int nsamples;
+    volatile int valid;
+    unsigned clock_time_stamp_nsec;
+    unsigned receive_time_stamp_nsec;
+    int dummy[8];
+};
+
+namespace
+{
+    ntp_shm_time* attach_ntp_shm(int unit, bool create)
+    {
+        // Units 0 and 1 are root only, higher units can be used by non root writers
+        int perms = (unit < 2) ? 0600 : 0666;
+        int shm_id = shmget((key_t)(ntp_shm_key_base + unit), sizeof(ntp_shm_time), create ? (IPC_CREAT | perms) : 0);
+        if (shm_id == -1)
+        {
+            return nullptr;
+        }
+
+        void* p = shmat(shm_id, nullptr, 0);
+        if (p == (void*)-1)
+        {
+            return nullptr;
+        }
+
+        return static_cast<ntp_shm_time*>(p);
+    }
+
+    std::int64_t timespec_diff_ns(const std::timespec& end, const std::timespec& start)
+    {
+        return (std::int64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+    }
+}
+
+ntp_shm_writer::~ntp_shm_writer()
+{
+    close();
+}
+
+bool ntp_shm_writer::open(int unit)
+{
+    close();
+
+    segment = attach_ntp_shm(unit, true);
+    if (segment == nullptr)
+    {
+        return false;
+    }
+
+    segment->valid = 0;
+    segment->mode = 1;
+    segment->nsamples = 3;
+
+    latency_stats = {};
+
+    return true;
+}
+
+void ntp_shm_writer::close()
+{
+    if (segment != nullptr)
+    {
+        shmdt(segment);
+        segment = nullptr;
+    }
+}
+
+bool ntp_shm_writer::write(const ntp_shm_sample& sample)
+{
+    if (segment == nullptr)
+    {
+        return false;
+    }
+
+    // Mode 1 protocol: invalidate and bump count before touching the payload,
+    // bump count again after, so a reader seeing a count change discards the sample.
+    // Lock free, the writer never waits on the reader.
+
+    segment->valid = 0;
+    segment->count = segment->count + 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    segment->clock_time_stamp_sec = sample.clock_time.tv_sec;
+    segment->clock_time_stamp_usec = (int)(sample.clock_time.tv_nsec / 1000);
+    segment->clock_time_stamp_nsec = (unsigned)sample.clock_time.tv_nsec;
+    segment->receive_time_stamp_sec = sample.receive_time.tv_sec;
+    segment->receive_time_stamp_usec = (int)(sample.receive_time.tv_nsec / 1000);
+    segment->receive_time_stamp_nsec = (unsigned)sample.receive_time.tv_nsec;
+    segment->leap = sample.leap;
+    segment->precision = sample.precision;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    segment->count = segment->count + 1;
+    segment->valid = 1;
+
+    std::timespec now = {};
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    std::int64_t latency = timespec_diff_ns(now, sample.receive_time);
+
+    latency_stats.last_latency_ns = latency;
+    latency_stats.min_latency_ns = (latency_stats.samples == 0) ? latency : std::min(latency_stats.min_latency_ns, latency);
+    latency_stats.max_latency_ns = (latency_stats.samples == 0) ? latency : std::max(latency_stats.max_latency_ns, latency);
+    latency_stats.total_latency_ns += latency;
+    latency_stats.samples++;
+
+    return true;
+}
+
+const ntp_shm_stats& ntp_shm_writer::stats() const
+{
+    return latency_stats;
+}
+
+bool try_read_ntp_shm(int unit, ntp_shm_sample& sample)
+{
+    ntp_shm_time* segment = attach_ntp_shm(unit, false);
+    if (segment == nullptr)
+    {
+        return false;
+    }
+
+    bool result = false;
+
+    do
+    {
+        if (segment->mode != 1 || !segment->valid)
+        {
+            break;
+        }
+
+        int count = segment->count;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        ntp_shm_sample s;
+        s.clock_time.tv_sec = segment->clock_time_stamp_sec;
+        s.clock_time.tv_nsec = segment->clock_time_stamp_nsec;
+        s.receive_time.tv_sec = segment->receive_time_stamp_sec;
+        s.receive_time.tv_nsec = segment->receive_time_stamp_nsec;
+        s.leap = segment->leap;
+        s.precision = segment->precision;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // Torn read, the writer updated the segment while it was being copied
+        if (count != segment->count)
+        {
+            break;
+        }
+
+        sample = s;
+        result = true;
+    }
+    while (false);
+
+    shmdt(segment);
+
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ctime>
+#include <cstdint>
+
+// Key of the NTP shared memory refclock segment SHM(0), unit n uses ntp_shm_key_base + n
+constexpr int ntp_shm_key_base = 0x4e545030;
+
+struct ntp_shm_sample
+{
+    std::timespec clock_time = {};   // reference time, from GPS
+    std::timespec receive_time = {}; // local system time at which clock_time was received
+    int leap = 0;                    // always 0 (no warning), the gpsd client API does not report pending leap seconds
+    int precision = -1;
+};
+
+struct ntp_shm_stats
+{
+    std::uint64_t samples = 0;
+    std::int64_t last_latency_ns = 0;
+    std::int64_t min_latency_ns = 0;
+    std::int64_t max_latency_ns = 0;
+    std::int64_t total_latency_ns = 0;
+};
+
+// Writes time samples into the ntpd/chrony SHM refclock segment using mode 1 (count/valid protocol)
+class ntp_shm_writer
+{
+public:
+    ntp_shm_writer() = default;
+    ~ntp_shm_writer();
+    ntp_shm_writer(const ntp_shm_writer&) = delete;
+    ntp_shm_writer& operator=(const ntp_shm_writer&) = delete;
+    bool open(int unit = 0);
+    void close();
+    bool write(const ntp_shm_sample& sample);
+    const ntp_shm_stats& stats() const;
+private:
+    struct ntp_shm_time* segment = nullptr;
+    ntp_shm_stats latency_stats;
+};
+
+// Reads the current sample back from the segment using the mode 1 count check, valid is left set
+bool try_read_ntp_shm(int unit, ntp_shm_sample& sample);
@@ -0,0 +1,102 @@
+
+#include "output_filter.h"
+#include "geodesy.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    double heading_difference(double a, double b)
+    {
+        double d = std::fmod(std::abs(a - b), 360.0);
+        return (d > 180.0) ? (360.0 - d) : d;
+    }
+}
+
+output_filter::output_filter(const output_filter_options& options) : options(options)
+{
+}
+
+bool output_filter::accept(const gnss_info& info)
+{
+    return accept(info, std::chrono::steady_clock::now());
+}
+
+bool output_filter::accept(const gnss_info& info, std::chrono::steady_clock::time_point now)
+{
+    bool emit = false;
+
+    do
+    {
+        if (!has_last)
+        {
+            emit = true;
+            break;
+        }
+
+        double elapsed = std::chrono::duration<double>(now - last_time).count();
+
+        if (options.fix_mode_change && info.mode != last_info.mode)
+        {
+            emit = true;
+            break;
+        }
+
+        if (options.min_interval > 0 && elapsed < options.min_interval)
+        {
+            break;
+        }
+
+        if (options.max_interval > 0 && elapsed >= options.max_interval)
+        {
+            emit = true;
+            break;
+        }
+
+        // Without change thresholds the filter only rate limits
+        if (options.min_distance <= 0 && options.min_heading_change <= 0)
+        {
+            emit = true;
+            break;
+        }
+
+        if (options.min_distance > 0 && std::isfinite(info.lat) && std::isfinite(info.lon))
+        {
+            if (!std::isfinite(last_info.lat) || !std::isfinite(last_info.lon) ||
+                haversine_distance(last_info.lat, last_info.lon, info.lat, info.lon) >= options.min_distance)
+            {
+                emit = true;
+                break;
+            }
+        }
+
+        // A stationary receiver reports a random track, only trust it while moving
+        if (options.min_heading_change > 0 && std::isfinite(info.track) &&
+            std::isfinite(info.speed) && info.speed >= options.min_heading_speed)
+        {
+            if (!std::isfinite(last_info.track) ||
+                heading_difference(last_info.track, info.track) >= options.min_heading_change)
+            {
+                emit = true;
+                break;
+            }
+        }
+    }
+    while (false);
+
+    if (emit)
+    {
+        last_info = info;
+        last_time = now;
+        has_last = true;
+    }
+
+    return emit;
+}
+
+void output_filter::reset()
+{
+    has_last = false;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "gps.h"
+
+#include <chrono>
+
+struct output_filter_options
+{
+    double min_distance = 0;        // meters moved since the last emitted fix, 0 disables
+    double min_heading_change = 0;  // degrees of track change since the last emitted fix, 0 disables
+    double min_heading_speed = 0.5; // m/s, below this the track is noise and the heading test is skipped
+    double min_interval = 0;        // seconds, fixes arriving sooner than this after the last emitted one are dropped, 0 disables
+    double max_interval = 0;        // seconds, a fix is always emitted once this much time has passed, 0 disables
+    bool fix_mode_change = true;    // emit when the fix mode changes, even inside min_interval
+};
+
+// Decides which fixes of a continuous feed are worth formatting and writing
+class output_filter
+{
+public:
+    output_filter() = default;
+    output_filter(const output_filter_options& options);
+    bool accept(const gnss_info& info);
+    bool accept(const gnss_info& info, std::chrono::steady_clock::time_point now);
+    void reset();
+private:
+    output_filter_options options;
+    gnss_info last_info;
+    std::chrono::steady_clock::time_point last_time;
+    bool has_last = false;
+};
@@ -0,0 +1,500 @@
+
+#include "output_template.h"
+#include "position_view.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+
+using namespace std;
+
+namespace
+{
+    struct template_field_name
+    {
+        const char* name;
+        template_field field;
+    };
+
+    const template_field_name template_field_names[] =
+    {
+        { "lat", template_field::lat },
+        { "lon", template_field::lon },
+        { "lat_dd", template_field::lat_dd },
+        { "lon_dd", template_field::lon_dd },
+        { "lat_ddm", template_field::lat_ddm },
+        { "lon_ddm", template_field::lon_ddm },
+        { "lat_dms", template_field::lat_dms },
+        { "lon_dms", template_field::lon_dms },
+        { "lat_ddm_short", template_field::lat_ddm_short },
+        { "lon_ddm_short", template_field::lon_ddm_short },
+        { "alt", template_field::alt },
+        { "speed", template_field::speed },
+        { "track", template_field::track },
+        { "satellites", template_field::satellites },
+        { "mode", template_field::mode },
+        { "utc", template_field::utc },
+        { "time", template_field::time },
+    };
+
+    bool try_parse_template_field(const std::string& name, template_field& field)
+    {
+        for (const auto& f : template_field_names)
+        {
+            if (name == f.name)
+            {
+                field = f.field;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool is_numeric_field(template_field field)
+    {
+        return field == template_field::lat || field == template_field::lon ||
+            field == template_field::alt || field == template_field::speed ||
+            field == template_field::track || field == template_field::satellites;
+    }
+
+    bool is_time_field(template_field field)
+    {
+        return field == template_field::utc || field == template_field::time;
+    }
+
+    void append_literal(output_template& tmpl, const std::string& text)
+    {
+        if (text.empty())
+        {
+            return;
+        }
+        // Merge adjacent literals so rendering does one append per run of text
+        if (!tmpl.ops.empty() && tmpl.ops.back().field == template_field::literal)
+        {
+            tmpl.ops.back().text += text;
+            return;
+        }
+        tmpl.ops.push_back({ template_field::literal, text, {} });
+    }
+
+    // Limits keep the rendered size of any accepted spec bounded
+    constexpr int max_number_width = 256;
+    constexpr int max_number_precision = 30;
+    constexpr size_t max_time_format_size = 256;
+    constexpr size_t max_time_size = 4096;
+
+    bool try_parse_number(const std::string& str, size_t& i, int max, int& number)
+    {
+        size_t start = i;
+        number = 0;
+        while (i < str.size() && std::isdigit((unsigned char)str[i]))
+        {
+            number = number * 10 + (str[i] - '0');
+            if (number > max)
+            {
+                return false;
+            }
+            i++;
+        }
+        return i > start;
+    }
+
+    bool is_align(char c)
+    {
+        return c == '<' || c == '>' || c == '^';
+    }
+
+    bool try_parse_number_format(const std::string& spec, bool integer, template_number_format& format)
+    {
+        format = {};
+
+        size_t i = 0;
+        bool has_align = false;
+
+        if (spec.size() >= 2 && is_align(spec[1]))
+        {
+            format.fill = spec[0];
+            format.align = spec[1];
+            has_align = true;
+            i = 2;
+        }
+        else if (!spec.empty() && is_align(spec[0]))
+        {
+            format.align = spec[0];
+            has_align = true;
+            i = 1;
+        }
+
+        if (i < spec.size() && (spec[i] == '+' || spec[i] == '-' || spec[i] == ' '))
+        {
+            format.sign = spec[i++];
+        }
+
+        // As in fmt, zero padding is ignored when an alignment is given
+        if (i < spec.size() && spec[i] == '0')
+        {
+            format.zero_pad = !has_align;
+            i++;
+        }
+
+        if (i < spec.size() && std::isdigit((unsigned char)spec[i]) && !try_parse_number(spec, i, max_number_width, format.width))
+        {
+            return false;
+        }
+
+        if (i < spec.size() && spec[i] == '.')
+        {
+            i++;
+            if (integer || !try_parse_number(spec, i, max_number_precision, format.precision))
+            {
+                return false;
+            }
+        }
+
+        if (i < spec.size())
+        {
+            format.type = spec[i++];
+            const char* types = integer ? "d" : "fFeEgG";
+            if (std::strchr(types, format.type) == nullptr)
+            {
+                return false;
+            }
+        }
+
+        return i == spec.size();
+    }
+
+    bool is_valid_time_format(const std::string& format)
+    {
+        if (format.empty() || format.size() > max_time_format_size)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < format.size(); i++)
+        {
+            if (format[i] != '%')
+            {
+                continue;
+            }
+            i++;
+            if (i < format.size() && (format[i] == 'E' || format[i] == 'O'))
+            {
+                i++;
+            }
+            if (i >= format.size() || format[i] == '\0' || std::strchr("aAbBcCdDeFgGhHIjmMnprRStTuUVwWxXyYzZ%", format[i]) == nullptr)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void append_padded(const template_number_format& format, const char* first, const char* last, std::string& buffer)
+    {
+        char sign = 0;
+        if (first != last && *first == '-')
+        {
+            sign = '-';
+            first++;
+        }
+        else if (format.sign != '-')
+        {
+            sign = format.sign;
+        }
+
+        size_t size = (size_t)(last - first) + (sign != 0 ? 1 : 0);
+        size_t padding = ((size_t)format.width > size) ? (size_t)format.width - size : 0;
+
+        // nan and inf are padded with spaces, like fmt does
+        bool finite = first != last && std::isdigit((unsigned char)*first);
+        if (format.zero_pad && finite)
+        {
+            if (sign != 0)
+                buffer.push_back(sign);
+            buffer.append(padding, '0');
+            buffer.append(first, last);
+            return;
+        }
+
+        char align = (format.align != 0) ? format.align : ((finite || format.zero_pad) ? '>' : '<');
+        size_t left = (align == '<') ? 0 : (align == '^') ? padding / 2 : padding;
+
+        buffer.append(left, format.fill);
+        if (sign != 0)
+            buffer.push_back(sign);
+        buffer.append(first, last);
+        buffer.append(padding - left, format.fill);
+    }
+
+    void append_number(const template_number_format& format, double value, std::string& buffer)
+    {
+        // Large enough for a fixed 1e308 with max_number_precision digits
+        char str[512];
+        std::to_chars_result r;
+
+        switch (format.type)
+        {
+            case 'f':
+            case 'F':
+                r = std::to_chars(str, str + sizeof(str), value, std::chars_format::fixed, format.precision < 0 ? 6 : format.precision);
+                break;
+            case 'e':
+            case 'E':
+                r = std::to_chars(str, str + sizeof(str), value, std::chars_format::scientific, format.precision < 0 ? 6 : format.precision);
+                break;
+            case 'g':
+            case 'G':
+                r = std::to_chars(str, str + sizeof(str), value, std::chars_format::general, format.precision < 0 ? 6 : format.precision);
+                break;
+            default:
+                r = (format.precision < 0) ?
+                    std::to_chars(str, str + sizeof(str), value) :
+                    std::to_chars(str, str + sizeof(str), value, std::chars_format::general, format.precision);
+                break;
+        }
+
+        if (r.ec != std::errc())
+        {
+            return;
+        }
+
+        if (format.type == 'F' || format.type == 'E' || format.type == 'G')
+        {
+            std::transform(str, r.ptr, str, [](char c) { return (char)std::toupper((unsigned char)c); });
+        }
+
+        append_padded(format, str, r.ptr, buffer);
+    }
+
+    void append_number(const template_number_format& format, int value, std::string& buffer)
+    {
+        char str[16];
+        std::to_chars_result r = std::to_chars(str, str + sizeof(str), value);
+        append_padded(format, str, r.ptr, buffer);
+    }
+
+    void append_time(const date_time& t, const std::string& time_format, std::string& buffer)
+    {
+        if (t.year < 0)
+        {
+            return;
+        }
+
+        std::tm tm = {};
+        tm.tm_year = t.year - 1900;
+        tm.tm_mon = t.month - 1;
+        tm.tm_mday = t.day;
+        tm.tm_hour = t.hour;
+        tm.tm_min = t.minute;
+        tm.tm_sec = t.second;
+
+        // strftime returns 0 when the result does not fit, grow the space and retry
+        size_t offset = buffer.size();
+        for (size_t capacity = 128; capacity <= max_time_size; capacity *= 2)
+        {
+            buffer.resize(offset + capacity);
+            size_t size = std::strftime(buffer.data() + offset, capacity, time_format.c_str(), &tm);
+            if (size > 0)
+            {
+                buffer.resize(offset + size);
+                return;
+            }
+        }
+        buffer.resize(offset);
+    }
+
+    const char* fix_mode_to_string(fix_mode mode)
+    {
+        switch (mode)
+        {
+            case fix_mode::d2:
+                return "2D";
+            case fix_mode::d3:
+                return "3D";
+            default:
+                return "None";
+        }
+    }
+}
+
+bool try_parse_output_template(const std::string& str, output_template& tmpl, std::string& error)
+{
+    tmpl = {};
+
+    std::string literal;
+    size_t i = 0;
+
+    while (i < str.size())
+    {
+        char c = str[i];
+
+        if (c == '}')
+        {
+            if (i + 1 < str.size() && str[i + 1] == '}')
+            {
+                literal += '}';
+                i += 2;
+                continue;
+            }
+            error = fmt::format("Unmatched '}}' at position {} in template", i);
+            return false;
+        }
+
+        if (c != '{')
+        {
+            literal += c;
+            i++;
+            continue;
+        }
+
+        if (i + 1 < str.size() && str[i + 1] == '{')
+        {
+            literal += '{';
+            i += 2;
+            continue;
+        }
+
+        size_t end = str.find('}', i + 1);
+        if (end == std::string::npos)
+        {
+            error = fmt::format("Unterminated '{{' at position {} in template", i);
+            return false;
+        }
+
+        std::string field_str = str.substr(i + 1, end - i - 1);
+        std::string name = field_str;
+        std::string spec;
+        bool has_spec = false;
+
+        size_t colon = field_str.find(':');
+        if (colon != std::string::npos)
+        {
+            name = field_str.substr(0, colon);
+            spec = field_str.substr(colon + 1);
+            has_spec = true;
+        }
+
+        template_op op;
+
+        if (!try_parse_template_field(name, op.field))
+        {
+            error = fmt::format("Unknown template field '{}'", name);
+            return false;
+        }
+
+        if (is_time_field(op.field))
+        {
+            op.text = has_spec ? spec : "%Y-%m-%dT%H:%M:%S";
+
+            if (!is_valid_time_format(op.text))
+            {
+                error = fmt::format("Invalid strftime format '{}' for template field '{}'", spec, name);
+                return false;
+            }
+        }
+        else if (is_numeric_field(op.field))
+        {
+            // Parsed once here rather than on every fix
+            if (has_spec && !try_parse_number_format(spec, op.field == template_field::satellites, op.number))
+            {
+                error = fmt::format("Invalid format '{}' for template field '{}', expected [[fill]align][sign][0][width][.precision][type]", spec, name);
+                return false;
+            }
+        }
+        else if (has_spec)
+        {
+            error = fmt::format("Template field '{}' does not take a format", name);
+            return false;
+        }
+
+        append_literal(tmpl, literal);
+        literal.clear();
+        tmpl.ops.push_back(std::move(op));
+
+        i = end + 1;
+    }
+
+    append_literal(tmpl, literal);
+
+    return true;
+}
+
+void render_output_template(const output_template& tmpl, const gnss_info& info, std::string& buffer)
+{
+    render_output_template(tmpl, position_view(info), buffer);
+}
+
+void render_output_template(const output_template& tmpl, const position_view& view, std::string& buffer)
+{
+    buffer.clear();
+
+    // Position conversions happen lazily in the view, on the first op that needs them
+    const gnss_info& info = view.info();
+
+    for (const auto& op : tmpl.ops)
+    {
+        switch (op.field)
+        {
+            case template_field::literal:
+                buffer.append(op.text);
+                break;
+            case template_field::lat:
+                append_number(op.number, info.lat, buffer);
+                break;
+            case template_field::lon:
+                append_number(op.number, info.lon, buffer);
+                break;
+            case template_field::lat_dd:
+                buffer.append(view.dd_display().lat);
+                break;
+            case template_field::lon_dd:
+                buffer.append(view.dd_display().lon);
+                break;
+            case template_field::lat_ddm:
+                buffer.append(view.ddm_display().lat);
+                break;
+            case template_field::lon_ddm:
+                buffer.append(view.ddm_display().lon);
+                break;
+            case template_field::lat_dms:
+                buffer.append(view.dms_display().lat);
+                break;
+            case template_field::lon_dms:
+                buffer.append(view.dms_display().lon);
+                break;
+            case template_field::lat_ddm_short:
+                buffer.append(view.ddm_short_display().lat);
+                break;
+            case template_field::lon_ddm_short:
+                buffer.append(view.ddm_short_display().lon);
+                break;
+            case template_field::alt:
+                append_number(op.number, info.alt, buffer);
+                break;
+            case template_field::speed:
+                append_number(op.number, info.speed, buffer);
+                break;
+            case template_field::track:
+                append_number(op.number, info.track, buffer);
+                break;
+            case template_field::satellites:
+                append_number(op.number, info.satellites, buffer);
+                break;
+            case template_field::mode:
+                buffer.append(fix_mode_to_string(info.mode));
+                break;
+            case template_field::utc:
+                append_time(info.time_utc, op.text, buffer);
+                break;
+            case template_field::time:
+                append_time(info.time, op.text, buffer);
+                break;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "gps.h"
+
+#include <string>
+#include <vector>
+
+enum class template_field
+{
+    literal,
+    lat,
+    lon,
+    lat_dd,
+    lon_dd,
+    lat_ddm,
+    lon_ddm,
+    lat_dms,
+    lon_dms,
+    lat_ddm_short,
+    lon_ddm_short,
+    alt,
+    speed,
+    track,
+    satellites,
+    mode,
+    utc,
+    time
+};
+
+// A numeric format spec, the [[fill]align][sign][0][width][.precision][type] subset of the
+// fmt spec, parsed once so rendering a fix never parses a format string
+struct template_number_format
+{
+    char fill = ' ';
+    char align = 0;       // '<', '>', '^', or 0 for right, left for unpadded nan and inf as in fmt
+    char sign = '-';      // '-', '+' or ' '
+    bool zero_pad = false;
+    int width = 0;
+    int precision = -1;   // -1 is the shortest representation that round trips
+    char type = 0;        // 0, 'f', 'F', 'e', 'E', 'g', 'G', or 'd' for satellites
+};
+
+struct template_op
+{
+    template_field field = template_field::literal;
+    // Literal text, or a strftime format for utc and time
+    std::string text;
+    template_number_format number;
+};
+
+struct output_template
+{
+    std::vector<template_op> ops;
+};
+
+// Parses a template like "{utc:%H%M%S} {lat_ddm_short} {lon_ddm_short} {speed:.1f}", "{{" and "}}" are literal braces
+bool try_parse_output_template(const std::string& str, output_template& tmpl, std::string& error);
+
+// Clears buffer and renders the fix into it, only the position conversions the template references are computed
+void render_output_template(const output_template& tmpl, const gnss_info& info, std::string& buffer);
+void render_output_template(const output_template& tmpl, const position_view& view, std::string& buffer);
@@ -0,0 +1,10 @@
+#pragma once
+
+// Internal, the one place external/position.hpp is configured and included.
+// Only position_view.h includes this, public headers forward declare position_view instead.
+#define POSITION_LIB_NAMESPACE_BEGIN
+#define POSITION_LIB_NAMESPACE_END
+#define POSITION_LIB_DETAIL_NAMESPACE_BEGIN
+#define POSITION_LIB_DETAIL_NAMESPACE_REFERENCE
+#define POSITION_LIB_DETAIL_NAMESPACE_END
+#include "external/position.hpp"
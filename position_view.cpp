@@ -0,0 +1,72 @@
+
+#include "position_view.h"
+
+using namespace std;
+
+position_view::position_view(const gnss_info& info) : gnss(info), position{ info.lat, info.lon }
+{
+}
+
+const gnss_info& position_view::info() const
+{
+    return gnss;
+}
+
+const position_dd& position_view::dd() const
+{
+    return position;
+}
+
+const position_ddm& position_view::ddm() const
+{
+    if (!ddm_position)
+    {
+        ddm_position.emplace(position);
+    }
+    return *ddm_position;
+}
+
+const position_dms& position_view::dms() const
+{
+    if (!dms_position)
+    {
+        dms_position.emplace(position);
+    }
+    return *dms_position;
+}
+
+const position_display_string& position_view::dd_display() const
+{
+    if (!dd_string)
+    {
+        dd_string = format(position, position_dd_format);
+    }
+    return *dd_string;
+}
+
+const position_display_string& position_view::ddm_display() const
+{
+    if (!ddm_string)
+    {
+        ddm_string = format(ddm(), position_ddm_format);
+    }
+    return *ddm_string;
+}
+
+const position_display_string& position_view::dms_display() const
+{
+    if (!dms_string)
+    {
+        dms_string = format(dms(), position_dms_format);
+    }
+    return *dms_string;
+}
+
+const position_display_string& position_view::ddm_short_display() const
+{
+    if (!ddm_short_string)
+    {
+        ddm_short_string = format(ddm(), position_ddm_short_format);
+    }
+    return *ddm_short_string;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "gps.h"
+#include "position_lib.h"
+
+#include <optional>
+
+// Per fix view over the position representations used by the outputs.
+// Each conversion and display string is computed at most once, on first access,
+// so several outputs of the same fix share the work. The gnss_info must outlive the view.
+class position_view
+{
+public:
+    explicit position_view(const gnss_info& info);
+    position_view(const position_view&) = delete;
+    position_view& operator=(const position_view&) = delete;
+    const gnss_info& info() const;
+    const position_dd& dd() const;
+    const position_ddm& ddm() const;
+    const position_dms& dms() const;
+    const position_display_string& dd_display() const;
+    const position_display_string& ddm_display() const;
+    const position_display_string& dms_display() const;
+    const position_display_string& ddm_short_display() const;
+private:
+    const gnss_info& gnss;
+    position_dd position;
+    mutable std::optional<position_ddm> ddm_position;
+    mutable std::optional<position_dms> dms_position;
+    mutable std::optional<position_display_string> dd_string;
+    mutable std::optional<position_display_string> ddm_string;
+    mutable std::optional<position_display_string> dms_string;
+    mutable std::optional<position_display_string> ddm_short_string;
+};
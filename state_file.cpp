@@ -0,0 +1,383 @@
+
+#include "state_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+    constexpr int state_file_read_retries = 100;
+
+    bool write_all(int fd, const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            size -= (std::size_t)written;
+        }
+        return true;
+    }
+
+    std::string directory_of(const std::string& filename)
+    {
+        std::size_t slash = filename.rfind('/');
+        if (slash == std::string::npos)
+        {
+            return ".";
+        }
+        return (slash == 0) ? "/" : filename.substr(0, slash);
+    }
+
+    bool sync_directory(const std::string& directory)
+    {
+        int dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd == -1)
+        {
+            return false;
+        }
+        bool result = fsync(dir_fd) == 0;
+        ::close(dir_fd);
+        return result;
+    }
+
+    char* state_file_contents(void* mapping)
+    {
+        return static_cast<char*>(mapping) + sizeof(state_file_header);
+    }
+}
+
+state_file_writer::~state_file_writer()
+{
+    close();
+}
+
+bool state_file_writer::open(const std::string& filename, const state_file_options& options)
+{
+    close();
+
+    this->filename = filename;
+    this->temp_filename = filename + ".tmp";
+    this->directory = directory_of(filename);
+    this->options = options;
+    has_pending = false;
+    has_written = false;
+
+    if (options.strategy == state_file_strategy::mmap)
+    {
+        mapping_size = sizeof(state_file_header) + options.capacity;
+
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        // Allocate all blocks up front, updates never extend the file
+        if (ftruncate(fd, (off_t)mapping_size) != 0 || posix_fallocate(fd, 0, (off_t)mapping_size) != 0)
+        {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            mapping = nullptr;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        state_file_header* header = static_cast<state_file_header*>(mapping);
+        std::atomic_ref<std::uint64_t> generation(header->generation);
+
+        // Keep the generation of an existing file so readers never see it go backwards
+        std::uint64_t g = (std::memcmp(header->magic, state_file_magic, sizeof(state_file_magic)) == 0) ? generation.load() : 0;
+        generation.store(g | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(header->magic, state_file_magic, sizeof(state_file_magic));
+        header->version = state_file_version;
+        header->capacity = (std::uint32_t)options.capacity;
+        header->size = 0;
+
+        // The generation stays odd until the first write, readers never see the empty contents
+    }
+
+    is_open = true;
+
+    return true;
+}
+
+bool state_file_writer::close()
+{
+    if (!is_open)
+    {
+        return false;
+    }
+
+    // Write out the last coalesced contents
+    bool result = flush();
+
+    if (mapping != nullptr)
+    {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+    }
+
+    if (fd != -1)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+
+    is_open = false;
+
+    return result;
+}
+
+bool state_file_writer::write(std::string_view contents)
+{
+    if (!is_open)
+    {
+        return false;
+    }
+
+    switch (options.strategy)
+    {
+        case state_file_strategy::direct:
+            return write_direct(contents);
+        case state_file_strategy::mmap:
+            return write_mmap(contents);
+        case state_file_strategy::rename:
+            break;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (has_written && std::chrono::duration<double>(now - last_write_time).count() < options.min_interval)
+    {
+        // Inside the interval, only keep the latest contents
+        pending.assign(contents);
+        has_pending = true;
+        return true;
+    }
+
+    has_pending = false;
+    last_write_time = now;
+    has_written = true;
+
+    return write_rename(contents);
+}
+
+bool state_file_writer::poll()
+{
+    if (!is_open || !has_pending)
+    {
+        return true;
+    }
+
+    if (std::chrono::duration<double>(std::chrono::steady_clock::now() - last_write_time).count() < options.min_interval)
+    {
+        return true;
+    }
+
+    return flush();
+}
+
+bool state_file_writer::flush()
+{
+    if (!is_open || !has_pending)
+    {
+        return true;
+    }
+
+    has_pending = false;
+    last_write_time = std::chrono::steady_clock::now();
+    has_written = true;
+
+    return write_rename(pending);
+}
+
+bool state_file_writer::write_direct(std::string_view contents)
+{
+    std::ofstream output_file(filename);
+    if (!output_file)
+    {
+        return false;
+    }
+
+    output_file << contents;
+    output_file.close();
+
+    return !output_file.fail();
+}
+
+bool state_file_writer::write_rename(std::string_view contents)
+{
+    int temp_fd = ::open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (temp_fd == -1)
+    {
+        return false;
+    }
+
+    bool result = write_all(temp_fd, contents.data(), contents.size());
+
+    if (result && options.sync)
+    {
+        result = fsync(temp_fd) == 0;
+    }
+
+    if (::close(temp_fd) != 0)
+    {
+        result = false;
+    }
+
+    // rename is atomic, readers see either the previous or the new file, never a partial one
+    if (!result || std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(temp_filename.c_str());
+        return false;
+    }
+
+    // Persist the rename itself, otherwise power loss can leave the old directory entry
+    if (options.sync && !sync_directory(directory))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool state_file_writer::write_mmap(std::string_view contents)
+{
+    if (contents.size() > options.capacity)
+    {
+        return false;
+    }
+
+    state_file_header* header = static_cast<state_file_header*>(mapping);
+    std::atomic_ref<std::uint64_t> generation(header->generation);
+
+    std::uint64_t g = generation.load(std::memory_order_relaxed);
+
+    // Already odd before the first write after open()
+    if ((g & 1) == 0)
+    {
+        g++;
+        generation.store(g, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    std::memcpy(state_file_contents(mapping), contents.data(), contents.size());
+    header->size = contents.size();
+
+    generation.store(g + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool try_parse_state_file_strategy(const std::string& str, state_file_strategy& strategy)
+{
+    if (str == "direct")
+        strategy = state_file_strategy::direct;
+    else if (str == "rename")
+        strategy = state_file_strategy::rename;
+    else if (str == "mmap")
+        strategy = state_file_strategy::mmap;
+    else
+        return false;
+    return true;
+}
+
+bool try_read_state_file(const std::string& filename, std::string& contents)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(state_file_header))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    std::size_t mapping_size = (std::size_t)st.st_size;
+    void* mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    state_file_header* header = static_cast<state_file_header*>(mapping);
+    std::atomic_ref<std::uint64_t> generation(header->generation);
+
+    bool result = false;
+
+    for (int i = 0; i < state_file_read_retries && !result; i++)
+    {
+        if (std::memcmp(header->magic, state_file_magic, sizeof(state_file_magic)) != 0)
+        {
+            break;
+        }
+
+        std::uint64_t g1 = generation.load(std::memory_order_acquire);
+        if (g1 & 1)
+        {
+            // Write in progress
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::uint64_t size = header->size;
+        if (size > mapping_size - sizeof(state_file_header))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::string s(state_file_contents(mapping), (std::size_t)size);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::uint64_t g2 = generation.load(std::memory_order_relaxed);
+
+        // Torn read, the writer updated the contents while they were being copied
+        if (g1 != g2)
+        {
+            continue;
+        }
+
+        contents = std::move(s);
+        result = true;
+    }
+
+    munmap(mapping, mapping_size);
+
+    return result;
+}
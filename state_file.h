@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+enum class state_file_strategy
+{
+    direct, // truncate and rewrite on every write, readers can observe a partial file
+    rename, // write a temporary file and rename it over the state file, coalesced to min_interval
+    mmap    // preallocated file updated in place, readers check the generation counter
+};
+
+struct state_file_options
+{
+    state_file_strategy strategy = state_file_strategy::direct;
+    double min_interval = 1.0;   // rename: seconds, at most one write reaches storage per interval
+    bool sync = true;            // rename: fsync the temporary file before renaming it and the directory after
+    std::size_t capacity = 4096; // mmap: maximum contents size in bytes
+};
+
+// Layout of a state file written with the mmap strategy. The contents follow the header.
+// generation is odd while the writer updates the contents and from open() until the first
+// write, so a file that was never written reads as unavailable. A reader which sees an odd
+// generation, or a different generation before and after copying, retries.
+struct state_file_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t capacity;
+    std::uint64_t generation;
+    std::uint64_t size;
+};
+
+constexpr char state_file_magic[8] = { 'G', 'P', 'S', 'S', 'T', 'A', 'T', 'E' };
+constexpr std::uint32_t state_file_version = 1;
+
+class state_file_writer
+{
+public:
+    state_file_writer() = default;
+    ~state_file_writer();
+    state_file_writer(const state_file_writer&) = delete;
+    state_file_writer& operator=(const state_file_writer&) = delete;
+    bool open(const std::string& filename, const state_file_options& options = {});
+    bool close();
+    bool write(std::string_view contents);
+    // Writes coalesced contents once min_interval has passed since the last write, call periodically
+    bool poll();
+    bool flush();
+private:
+    bool write_direct(std::string_view contents);
+    bool write_rename(std::string_view contents);
+    bool write_mmap(std::string_view contents);
+    std::string filename;
+    std::string temp_filename;
+    std::string directory;
+    state_file_options options;
+    bool is_open = false;
+    std::string pending;
+    bool has_pending = false;
+    bool has_written = false;
+    std::chrono::steady_clock::time_point last_write_time;
+    int fd = -1;
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+};
+
+bool try_parse_state_file_strategy(const std::string& str, state_file_strategy& strategy);
+
+// Reads a state file written with the mmap strategy, retrying on torn reads
+bool try_read_state_file(const std::string& filename, std::string& contents);
@@ -0,0 +1,272 @@
+
+#include "track_exporter.h"
+
+#include <fmt/format.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <iterator>
+
+using namespace std;
+
+namespace
+{
+    bool ends_with(const std::string& str, const std::string& suffix)
+    {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    void append_time(std::string& buffer, const date_time& t)
+    {
+        fmt::format_to(std::back_inserter(buffer), "{:04}-{:02}-{:02}T{:02}:{:02}:{:02}Z", t.year, t.month, t.day, t.hour, t.minute, t.second);
+    }
+}
+
+bool try_parse_track_format(const std::string& str, track_format& format)
+{
+    if (str == "gpx")
+        format = track_format::gpx;
+    else if (str == "geojson" || str == "json")
+        format = track_format::geojson;
+    else if (str == "kml")
+        format = track_format::kml;
+    else
+        return false;
+    return true;
+}
+
+bool try_get_track_format_from_filename(const std::string& filename, track_format& format)
+{
+    if (ends_with(filename, ".gpx"))
+        format = track_format::gpx;
+    else if (ends_with(filename, ".geojson") || ends_with(filename, ".json"))
+        format = track_format::geojson;
+    else if (ends_with(filename, ".kml"))
+        format = track_format::kml;
+    else
+        return false;
+    return true;
+}
+
+track_exporter::~track_exporter()
+{
+    close();
+}
+
+bool track_exporter::open(const std::string& filename, track_format format, std::size_t block_size)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    this->format = format;
+    this->block_size = block_size;
+    point_count = 0;
+    failed = false;
+
+    buffer.clear();
+    buffer.reserve(block_size + 1024);
+
+    append_header();
+
+    return true;
+}
+
+bool track_exporter::close()
+{
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    append_footer();
+
+    bool result = flush();
+
+    if (::close(fd) != 0)
+    {
+        result = false;
+    }
+
+    fd = -1;
+    buffer.clear();
+    buffer.shrink_to_fit();
+
+    return result && !failed;
+}
+
+bool track_exporter::write(const gnss_info& info)
+{
+    if (fd == -1 || failed)
+    {
+        return false;
+    }
+
+    if (!std::isfinite(info.lat) || !std::isfinite(info.lon))
+    {
+        return true;
+    }
+
+    append_point(info);
+    point_count++;
+
+    if (buffer.size() >= block_size)
+    {
+        return flush();
+    }
+
+    return true;
+}
+
+std::uint64_t track_exporter::points() const
+{
+    return point_count;
+}
+
+bool track_exporter::flush()
+{
+    const char* data = buffer.data();
+    std::size_t size = buffer.size();
+
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+        data += written;
+        size -= (std::size_t)written;
+    }
+
+    buffer.clear();
+
+    return true;
+}
+
+void track_exporter::append_header()
+{
+    switch (format)
+    {
+        case track_format::gpx:
+            buffer.append(
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<gpx version=\"1.1\" creator=\"gps_util\" xmlns=\"http://www.topografix.com/GPX/1/1\">\n"
+                "<trk>\n"
+                "<trkseg>\n");
+            break;
+        case track_format::geojson:
+            buffer.append("{\"type\":\"FeatureCollection\",\"features\":[\n");
+            break;
+        case track_format::kml:
+            buffer.append(
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+                "<Document>\n"
+                "<Placemark>\n"
+                "<name>gps_util track</name>\n"
+                "<LineString>\n"
+                "<coordinates>\n");
+            break;
+    }
+}
+
+void track_exporter::append_point(const gnss_info& info)
+{
+    auto out = std::back_inserter(buffer);
+    bool has_alt = std::isfinite(info.alt);
+    bool has_time = info.time_utc.year >= 0;
+
+    switch (format)
+    {
+        case track_format::gpx:
+            fmt::format_to(out, "<trkpt lat=\"{:.7f}\" lon=\"{:.7f}\">", info.lat, info.lon);
+            if (has_alt)
+            {
+                fmt::format_to(out, "<ele>{:.2f}</ele>", info.alt);
+            }
+            if (has_time)
+            {
+                buffer.append("<time>");
+                append_time(buffer, info.time_utc);
+                buffer.append("</time>");
+            }
+            if (info.satellites > 0)
+            {
+                fmt::format_to(out, "<sat>{}</sat>", info.satellites);
+            }
+            buffer.append("</trkpt>\n");
+            break;
+        case track_format::geojson:
+            if (point_count > 0)
+            {
+                buffer.append(",\n");
+            }
+            fmt::format_to(out, "{{\"type\":\"Feature\",\"geometry\":{{\"type\":\"Point\",\"coordinates\":[{:.7f},{:.7f}", info.lon, info.lat);
+            if (has_alt)
+            {
+                fmt::format_to(out, ",{:.2f}", info.alt);
+            }
+            buffer.append("]},\"properties\":{");
+            if (has_time)
+            {
+                buffer.append("\"time\":\"");
+                append_time(buffer, info.time_utc);
+                buffer.append("\",");
+            }
+            if (std::isfinite(info.speed))
+            {
+                fmt::format_to(out, "\"speed\":{:.3f},", info.speed);
+            }
+            if (std::isfinite(info.track))
+            {
+                fmt::format_to(out, "\"track\":{:.2f},", info.track);
+            }
+            fmt::format_to(out, "\"satellites\":{}}}}}", info.satellites);
+            break;
+        case track_format::kml:
+            fmt::format_to(out, "{:.7f},{:.7f}", info.lon, info.lat);
+            if (has_alt)
+            {
+                fmt::format_to(out, ",{:.2f}", info.alt);
+            }
+            buffer.append("\n");
+            break;
+    }
+}
+
+void track_exporter::append_footer()
+{
+    switch (format)
+    {
+        case track_format::gpx:
+            buffer.append(
+                "</trkseg>\n"
+                "</trk>\n"
+                "</gpx>\n");
+            break;
+        case track_format::geojson:
+            buffer.append("\n]}\n");
+            break;
+        case track_format::kml:
+            buffer.append(
+                "</coordinates>\n"
+                "</LineString>\n"
+                "</Placemark>\n"
+                "</Document>\n"
+                "</kml>\n");
+            break;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gps.h"
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+enum class track_format
+{
+    gpx,
+    geojson,
+    kml
+};
+
+bool try_parse_track_format(const std::string& str, track_format& format);
+bool try_get_track_format_from_filename(const std::string& filename, track_format& format);
+
+// Streams a track to a file as fixes arrive. Memory use is bounded by the write block size,
+// points are appended to a buffer and written out in whole blocks. close() writes the
+// document footer, a track is only valid once closed.
+class track_exporter
+{
+public:
+    track_exporter() = default;
+    ~track_exporter();
+    track_exporter(const track_exporter&) = delete;
+    track_exporter& operator=(const track_exporter&) = delete;
+    bool open(const std::string& filename, track_format format, std::size_t block_size = 1 << 20);
+    bool close();
+    bool write(const gnss_info& info);
+    std::uint64_t points() const;
+private:
+    bool flush();
+    void append_header();
+    void append_point(const gnss_info& info);
+    void append_footer();
+    int fd = -1;
+    track_format format = track_format::gpx;
+    std::size_t block_size = 0;
+    std::string buffer;
+    std::uint64_t point_count = 0;
+    bool failed = false;
+};